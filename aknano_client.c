@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include <time.h>
 
+#include "flash_wear.h"
 #include "flexspi_flash_config.h"
 #include "lwip/apps/sntp.h"
 #include "lwip/opt.h"
@@ -181,6 +182,12 @@ time_t aknano_cli_get_current_epoch()
     return boot_up_epoch + (xTaskGetTickCount() / 1000);
 }
 
+/* Flash wear counters, as a JSON object for the device report */
+int aknano_cli_get_flash_wear_report(char *buf, size_t size)
+{
+    return flash_wear_report(buf, size);
+}
+
 int initTime()
 {
         SNTPRequest();
@@ -12,6 +12,9 @@ fioctl_path="${HOME}/git_foundries/fioctl/bin"
 [ -n "${MCUBOOT_PATH}" ] && mcuboot_path=${MCUBOOT_PATH}
 [ -n "${FIOCTL_PATH}" ] && fioctl_path=${FIOCTL_PATH}
 
+signing_key="${mcuboot_path}/root-rsa-2048.pem"
+[ -n "${SIGNING_KEY}" ] && signing_key=${SIGNING_KEY}
+
 COLOR_RED="\e[31m"
 COLOR_GREEN="\e[32m"
 COLOR_YELLOW="\e[33m"
@@ -37,6 +40,8 @@ DO_PUBLISH=1
 PUBLISH_TAGS="devel"
 
 DO_BREAK_SIGNATURE=0
+DELTA_FROM=""
+DO_COMPRESS=0
 DO_TEST_BUILD=0
 build_type="release"
 
@@ -90,6 +95,14 @@ for i in "$@"; do
       DO_BREAK_SIGNATURE=1
       shift # past argument
       ;;
+    --delta-from=*)
+      DELTA_FROM="${i#*=}"
+      shift # past argument=value
+      ;;
+    --compress)
+      DO_COMPRESS=1
+      shift # past argument
+      ;;
     --debug)
       build_type="debug"
       shift # past argument
@@ -115,6 +128,13 @@ unsigned_file="${build_full_path}/ota_demo.bin"
 rm -f "${unsigned_file}"
 
 export AKNANO_BOARD_MODEL
+
+# embed the public key, for images to be checked on the device (image_signature.c)
+if [ -z "${AKNANO_IMAGE_SIGNING_PUB_KEY}" ]; then
+  python3 ${mcuboot_path}/scripts/imgtool.py getpub --key ${signing_key} > image_signing_pub_key.c
+  export AKNANO_IMAGE_SIGNING_PUB_KEY="$(pwd)/image_signing_pub_key.c"
+fi
+
 if [ $DO_TEST_BUILD -eq 1 ]; then
   # integration test build
   ./build_flexspi_nor_test.sh
@@ -137,7 +157,7 @@ if [ ${DO_FLASH_PRIMARY_SLOT} -eq 1 ]; then
 fi
 
 python3 ${mcuboot_path}/scripts/imgtool.py sign \
-        --key ${mcuboot_path}/root-rsa-2048.pem  \
+        --key ${signing_key}  \
         --align 4 \
         --header-size 0x400 \
         --pad-header \
@@ -153,6 +173,17 @@ if [ ${DO_BREAK_SIGNATURE} -eq 1 ]; then
     | dd of=${signed_file} bs=1 seek=25000 count=4 conv=notrunc
 fi
 
+if [ -n "${DELTA_FROM}" ]; then
+  # delta against the signed image running on the devices, see delta_apply.c
+  delta_file="${build_full_path}/ota_demo.delta.bin"
+  python3 ./mkdelta.py "${DELTA_FROM}" "${signed_file}" "${delta_file}"
+fi
+
+if [ ${DO_COMPRESS} -eq 1 ]; then
+  # compressed image, see image_decompress.c
+  python3 ./compress_image.py "${signed_file}" "${build_full_path}/ota_demo.signed.hs.bin"
+fi
+
 if [ ${DO_PUBLISH} -eq 1 -a ${DO_TEST_BUILD} -ne 1 ]; then
   echo -e "${COLOR_YELLOW}"
   echo -e "Publishing..."
@@ -184,6 +215,8 @@ echo -e "DO_FLASH                = ${DO_FLASH}"
 echo -e "DO_FLASH_PRIMARY_SLOT   = ${DO_FLASH_PRIMARY_SLOT}"
 echo -e "DO_FLASH_SECONDARY_SLOT = ${DO_FLASH_SECONDARY_SLOT}"
 echo -e "DO_BREAK_SIGNATURE      = ${DO_BREAK_SIGNATURE}"
+echo -e "DELTA_FROM              = ${DELTA_FROM}"
+echo -e "DO_COMPRESS             = ${DO_COMPRESS}"
 echo -e "DO_TEST_BUILD           = ${DO_TEST_BUILD}"
 echo -e "DO_FORCE_CLEANUP        = ${DO_FORCE_CLEANUP}"
 echo -e "DO_PUBLISH              = ${DO_PUBLISH}"
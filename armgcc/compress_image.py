@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+#
+# Copyright 2022 Foundries.io
+# All rights reserved.
+#
+# SPDX-License-Identifier: BSD-3-Clause
+#
+
+"""
+Compress a signed image for image_decompress.c, with a heatshrink compatible
+LZSS encoding. The device decompresses it back to the exact signed image.
+"""
+
+import argparse
+import struct
+import sys
+
+IMAGE_COMPRESS_MAGIC = 0x53484b41
+
+# Match candidates followed per position
+MAX_CHAIN = 32
+
+
+class BitWriter:
+    def __init__(self):
+        self.out = bytearray()
+        self.value = 0
+        self.count = 0
+
+    def put(self, value, bits):
+        self.value = (self.value << bits) | value
+        self.count += bits
+        while self.count >= 8:
+            self.count -= 8
+            self.out.append((self.value >> self.count) & 0xff)
+        self.value &= (1 << self.count) - 1
+
+    def data(self):
+        if self.count:
+            return bytes(self.out) + bytes([(self.value << (8 - self.count)) & 0xff])
+        return bytes(self.out)
+
+
+def compress(data, window_bits, lookahead_bits):
+    window = 1 << window_bits
+    max_len = 1 << lookahead_bits
+    # a back-reference has to be cheaper than the literals it replaces
+    min_len = (1 + window_bits + lookahead_bits) // 9 + 1
+
+    heads = {}
+    chain = [0] * len(data)
+    out = BitWriter()
+    pos = 0
+
+    def index(p):
+        if p + 3 <= len(data):
+            key = data[p:p + 3]
+            chain[p] = heads.get(key, -1)
+            heads[key] = p
+
+    while pos < len(data):
+        best_len, best_off = 0, 0
+        limit = min(max_len, len(data) - pos)
+        cand = heads.get(data[pos:pos + 3], -1) if pos + 3 <= len(data) else -1
+        depth = 0
+        while cand >= 0 and pos - cand <= window and depth < MAX_CHAIN:
+            length = 0
+            while length < limit and data[cand + length] == data[pos + length]:
+                length += 1
+            if length > best_len:
+                best_len, best_off = length, pos - cand
+                if length == limit:
+                    break
+            cand = chain[cand]
+            depth += 1
+
+        if best_len >= max(min_len, 3):
+            out.put(0, 1)
+            out.put(best_off - 1, window_bits)
+            out.put(best_len - 1, lookahead_bits)
+            for p in range(pos, pos + best_len):
+                index(p)
+            pos += best_len
+        else:
+            out.put(1, 1)
+            out.put(data[pos], 8)
+            index(pos)
+            pos += 1
+
+    return out.data()
+
+
+def decompress(stream, size, window_bits, lookahead_bits):
+    """Reference implementation of image_decompress.c, used to check the output"""
+    out = bytearray()
+    bit_pos = 0
+
+    def get(bits):
+        nonlocal bit_pos
+        value = 0
+        for _ in range(bits):
+            value = (value << 1) | ((stream[bit_pos >> 3] >> (7 - (bit_pos & 7))) & 1)
+            bit_pos += 1
+        return value
+
+    while len(out) < size:
+        if get(1):
+            out.append(get(8))
+        else:
+            offset = get(window_bits) + 1
+            for _ in range(get(lookahead_bits) + 1):
+                out.append(out[-offset] if offset <= len(out) else 0)
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().split('\n')[0])
+    parser.add_argument('input', help='signed image')
+    parser.add_argument('output', help='compressed image')
+    parser.add_argument('-w', '--window-bits', type=int, default=10,
+                        help='log2 of the window size, at most 11 (default: %(default)s)')
+    parser.add_argument('-l', '--lookahead-bits', type=int, default=6,
+                        help='log2 of the longest match (default: %(default)s)')
+    args = parser.parse_args()
+
+    if not 4 <= args.window_bits <= 11 or not 3 <= args.lookahead_bits < args.window_bits:
+        sys.exit('unsupported window/lookahead sizes')
+
+    with open(args.input, 'rb') as f:
+        data = f.read()
+
+    stream = compress(data, args.window_bits, args.lookahead_bits)
+    if decompress(stream, len(data), args.window_bits, args.lookahead_bits) != data:
+        sys.exit('compression self check failed')
+
+    with open(args.output, 'wb') as f:
+        f.write(struct.pack('<IBBHI', IMAGE_COMPRESS_MAGIC, args.window_bits, args.lookahead_bits, 0, len(data)))
+        f.write(stream)
+    print('%s: %u bytes for a %u bytes image (%.1f%%)' %
+          (args.output, len(stream) + 12, len(data), 100.0 * (len(stream) + 12) / len(data)))
+
+
+if __name__ == '__main__':
+    main()
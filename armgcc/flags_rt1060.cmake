@@ -3,6 +3,7 @@ SET(CMAKE_ASM_FLAGS_FLEXSPI_NOR_DEBUG " \
     -D__STARTUP_CLEAR_BSS \
     -DDEBUG \
     -D__STARTUP_INITIALIZE_NONCACHEDATA \
+    -D__STARTUP_INITIALIZE_RAMFUNCTION \
     -g \
     -mcpu=cortex-m7 \
     -Wall \
@@ -22,6 +23,7 @@ SET(CMAKE_ASM_FLAGS_FLEXSPI_NOR_RELEASE " \
     -D__STARTUP_CLEAR_BSS \
     -DNDEBUG \
     -D__STARTUP_INITIALIZE_NONCACHEDATA \
+    -D__STARTUP_INITIALIZE_RAMFUNCTION \
     -mcpu=cortex-m7 \
     -Wall \
     -mfloat-abi=hard \
@@ -24,6 +24,7 @@ SET(CMAKE_ASM_FLAGS_FLEXSPI_NOR_RELEASE " \
     -D__STARTUP_CLEAR_BSS \
     -DNDEBUG \
     -D__STARTUP_INITIALIZE_NONCACHEDATA \
+    -D__STARTUP_INITIALIZE_RAMFUNCTION \
     -DTX_ENABLE_FPU_SUPPORT=1 \
     -mcpu=cortex-m7 \
     -Wall \
@@ -67,6 +68,7 @@ SET(CMAKE_ASM_FLAGS_FLEXSPI_NOR_DEBUG " \
     -D__STARTUP_CLEAR_BSS \
     -DDEBUG \
     -D__STARTUP_INITIALIZE_NONCACHEDATA \
+    -D__STARTUP_INITIALIZE_RAMFUNCTION \
     -DTX_ENABLE_FPU_SUPPORT=1 \
     -g \
     -mcpu=cortex-m7 \
@@ -0,0 +1,209 @@
+#!/usr/bin/env python3
+#
+# Copyright 2022 Foundries.io
+# All rights reserved.
+#
+# SPDX-License-Identifier: BSD-3-Clause
+#
+
+"""
+Generate a delta between two signed mcuboot images, to be applied on the
+device by delta_apply.c on top of the image running from the active slot.
+
+The delta is a list of COPY operations, taking data from the old image, and
+INSERT operations carrying new data. See delta_apply.h for the format.
+"""
+
+import argparse
+import struct
+import sys
+
+DELTA_MAGIC = 0x4c444b41
+DELTA_OP_COPY = 0x01
+DELTA_OP_INSERT = 0x02
+
+IMAGE_MAGIC = 0x96f3b83d
+IMAGE_TLV_INFO_MAGIC = 0x6907
+IMAGE_TLV_SHA256 = 0x10
+
+# Size of the blocks of the old image indexed to look for matches
+BLOCK_SIZE = 16
+# Shorter matches cost more as copies than as inserted data
+MIN_COPY_SIZE = 24
+# Candidates kept per indexed block
+MAX_CANDIDATES = 8
+
+
+def image_digest(img):
+    """Return the SHA256 TLV value of a signed image"""
+    magic, _, hdr_size, prot_size, img_size = struct.unpack_from('<IIHHI', img, 0)
+    if magic != IMAGE_MAGIC:
+        raise ValueError('not a signed mcuboot image')
+    off = hdr_size + img_size + prot_size
+    it_magic, it_tot = struct.unpack_from('<HH', img, off)
+    if it_magic != IMAGE_TLV_INFO_MAGIC:
+        raise ValueError('no TLV area found')
+    end = off + it_tot
+    off += 4
+    while off + 4 <= end:
+        it_type, _, it_len = struct.unpack_from('<BBH', img, off)
+        off += 4
+        if it_type == IMAGE_TLV_SHA256 and it_len == 32:
+            return img[off:off + 32]
+        off += it_len
+    raise ValueError('no SHA256 TLV found')
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7f
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def zigzag(value):
+    return value * 2 if value >= 0 else -value * 2 - 1
+
+
+def match_length(a, ai, b, bi):
+    """Length of the common run of a[ai:] and b[bi:]"""
+    limit = min(len(a) - ai, len(b) - bi)
+    n = 0
+    step = 4096
+    while step:
+        while n + step <= limit and a[ai + n:ai + n + step] == b[bi + n:bi + n + step]:
+            n += step
+        step //= 2
+    return n
+
+
+class DeltaWriter:
+    def __init__(self):
+        self.ops = bytearray()
+        self.pending = bytearray()
+        self.old_pos = 0
+
+    def insert(self, data):
+        self.pending += data
+
+    def copy(self, old_off, length):
+        self.flush()
+        self.ops.append(DELTA_OP_COPY)
+        self.ops += varint(length)
+        self.ops += varint(zigzag(old_off - self.old_pos))
+        self.old_pos = old_off + length
+
+    def flush(self):
+        if self.pending:
+            self.ops.append(DELTA_OP_INSERT)
+            self.ops += varint(len(self.pending))
+            self.ops += self.pending
+            self.pending = bytearray()
+
+
+def make_delta(old, new):
+    index = {}
+    for i in range(0, len(old) - BLOCK_SIZE + 1, 4):
+        candidates = index.setdefault(old[i:i + BLOCK_SIZE], [])
+        if len(candidates) < MAX_CANDIDATES:
+            candidates.append(i)
+
+    writer = DeltaWriter()
+    pos = 0
+    while pos < len(new):
+        best_off, best_len = 0, 0
+
+        # data changed in place: keep going in the old image where the last copy ended
+        expected = writer.old_pos + len(writer.pending)
+        if expected < len(old):
+            best_off, best_len = expected, match_length(old, expected, new, pos)
+
+        if best_len < MIN_COPY_SIZE:
+            for off in index.get(new[pos:pos + BLOCK_SIZE], ()):
+                length = match_length(old, off, new, pos)
+                if length > best_len:
+                    best_off, best_len = off, length
+
+        if best_len < MIN_COPY_SIZE:
+            writer.insert(new[pos:pos + 1])
+            pos += 1
+            continue
+
+        # grow the match backwards over the data about to be inserted
+        while writer.pending and best_off > 0 and old[best_off - 1] == writer.pending[-1]:
+            writer.pending.pop()
+            best_off -= 1
+            best_len += 1
+            pos -= 1
+
+        writer.copy(best_off, best_len)
+        pos += best_len
+
+    writer.flush()
+    header = struct.pack('<III', DELTA_MAGIC, len(old), len(new)) + image_digest(old)
+    return header + bytes(writer.ops)
+
+
+def apply_delta(old, delta):
+    """Reference implementation of delta_apply.c, used to check the output"""
+    magic, old_size, new_size = struct.unpack_from('<III', delta, 0)
+    assert magic == DELTA_MAGIC and old_size == len(old)
+    pos = 12 + 32
+    old_pos = 0
+    new = bytearray()
+
+    def read_varint():
+        nonlocal pos
+        value, shift = 0, 0
+        while True:
+            byte = delta[pos]
+            pos += 1
+            value |= (byte & 0x7f) << shift
+            shift += 7
+            if not byte & 0x80:
+                return value
+
+    while len(new) < new_size:
+        op = delta[pos]
+        pos += 1
+        length = read_varint()
+        if op == DELTA_OP_COPY:
+            offset = read_varint()
+            old_pos += (offset >> 1) ^ -(offset & 1)
+            new += old[old_pos:old_pos + length]
+            old_pos += length
+        else:
+            new += delta[pos:pos + length]
+            pos += length
+    return bytes(new)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().split('\n')[0])
+    parser.add_argument('old', help='signed image currently running on the devices')
+    parser.add_argument('new', help='new signed image')
+    parser.add_argument('delta', help='output delta file')
+    args = parser.parse_args()
+
+    with open(args.old, 'rb') as f:
+        old = f.read()
+    with open(args.new, 'rb') as f:
+        new = f.read()
+
+    delta = make_delta(old, new)
+    if apply_delta(old, delta) != new:
+        sys.exit('delta self check failed')
+
+    with open(args.delta, 'wb') as f:
+        f.write(delta)
+    print('%s: %u bytes for a %u bytes image (%.1f%%)' %
+          (args.delta, len(delta), len(new), 100.0 * len(delta) / len(new)))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+#
+# Copyright 2022 Foundries.io
+# All rights reserved.
+#
+# SPDX-License-Identifier: BSD-3-Clause
+#
+
+"""
+Generate a partition table for partition_table.c, to be flashed at
+BOOT_FLASH_PARTITION_TABLE (0x6003f000 on RT1060, 0x3003f000 on RT1170).
+
+Each partition is given as type:id[:slot]:offset:size, with offsets physical:
+  slot:0:0:0x40000:0x200000     primary slot of the application
+  slot:0:1:0x240000:0x200000    secondary slot of the application
+  storage:0:0x440000:0x1000     download progress record
+  storage:1:0x441000:0x2000     update transaction record
+  slot:1:0:0x500000:0x80000     primary slot of data image 1 (update_txn.c)
+  slot:1:1:0x580000:0x80000     secondary slot of data image 1
+  data:0:0x600000:0x100000      application data
+"""
+
+import argparse
+import binascii
+import struct
+import sys
+
+PARTITION_TABLE_MAGIC = 0x54504b41
+PARTITION_TABLE_VERSION = 1
+PARTITION_TABLE_MAX_ENTRIES = 16
+PARTITION_MAX_IDS = 4
+SECTOR_SIZE = 0x1000
+
+TYPES = {'slot': 0, 'scratch': 1, 'storage': 2, 'data': 3}
+
+
+def parse_entry(spec):
+    fields = spec.split(':')
+    if not fields or fields[0] not in TYPES:
+        raise ValueError('unknown partition type in "%s"' % spec)
+
+    ptype = TYPES[fields[0]]
+    if ptype == TYPES['slot']:
+        if len(fields) != 5:
+            raise ValueError('expected slot:image:slot:offset:size, got "%s"' % spec)
+        pid, slot, offset, size = (int(f, 0) for f in fields[1:])
+    else:
+        if len(fields) != 4:
+            raise ValueError('expected %s:id:offset:size, got "%s"' % (fields[0], spec))
+        pid, offset, size = (int(f, 0) for f in fields[1:])
+        slot = 0
+
+    if pid >= PARTITION_MAX_IDS or slot > 1:
+        raise ValueError('id or slot out of range in "%s"' % spec)
+    if offset % SECTOR_SIZE or size % SECTOR_SIZE or size == 0:
+        raise ValueError('offset and size must be multiples of 0x%x in "%s"' % (SECTOR_SIZE, spec))
+
+    return struct.pack('<BBBBII', ptype, pid, slot, 0xff, offset, size)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().split('\n')[0],
+                                     formatter_class=argparse.RawDescriptionHelpFormatter,
+                                     epilog='\n'.join(__doc__.strip().split('\n')[3:]))
+    parser.add_argument('output', help='partition table binary')
+    parser.add_argument('partition', nargs='+', help='type:id[:slot]:offset:size')
+    args = parser.parse_args()
+
+    if len(args.partition) > PARTITION_TABLE_MAX_ENTRIES:
+        sys.exit('at most %u partitions' % PARTITION_TABLE_MAX_ENTRIES)
+
+    try:
+        entries = [parse_entry(p) for p in args.partition]
+    except ValueError as e:
+        sys.exit(str(e))
+
+    body = struct.pack('<IHH', PARTITION_TABLE_MAGIC, PARTITION_TABLE_VERSION, len(entries))
+    body += b''.join(entries) + b'\xff' * 12 * (PARTITION_TABLE_MAX_ENTRIES - len(entries))
+
+    with open(args.output, 'wb') as f:
+        f.write(body + struct.pack('<I', binascii.crc32(body) & 0xffffffff))
+
+
+if __name__ == '__main__':
+    main()
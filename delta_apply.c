@@ -0,0 +1,248 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "logging_levels.h"
+#define LIBRARY_LOG_NAME "delta_apply"
+#define LIBRARY_LOG_LEVEL LOG_INFO
+#include "logging_stack.h"
+
+#include <string.h>
+
+#include "delta_apply.h"
+#include "partition_table.h"
+
+enum
+{
+    kDeltaState_Header,
+    kDeltaState_Op,
+    kDeltaState_CopyLen,
+    kDeltaState_CopyOffset,
+    kDeltaState_InsertLen,
+    kDeltaState_InsertData,
+};
+
+/** Accumulate one byte of a LEB128 varint
+ *
+ * @retval kStatus_Success: the varint is complete in ctx->varint
+ *         kStatus_Busy: more bytes are needed
+ *         kStatus_Fail: the varint does not fit in 32 bits
+ */
+static status_t delta_varint_feed(delta_apply_t *ctx, uint8_t byte)
+{
+    if (ctx->varint_shift > 28 || (ctx->varint_shift == 28 && (byte & 0x70) != 0))
+    {
+        LogError(("Invalid varint at delta offset %u", ctx->received));
+        return kStatus_Fail;
+    }
+
+    ctx->varint |= (uint32_t)(byte & 0x7f) << ctx->varint_shift;
+    ctx->varint_shift += 7;
+
+    return (byte & 0x80) ? kStatus_Busy : kStatus_Success;
+}
+
+/* Copy len bytes of the old image at ctx->old_pos to the new one */
+static status_t delta_copy(delta_apply_t *ctx, uint32_t len)
+{
+    status_t status;
+
+    if (ctx->old_pos > ctx->hdr.old_size || len > ctx->hdr.old_size - ctx->old_pos ||
+        len > ctx->hdr.new_size - ctx->produced)
+    {
+        LogError(("Delta copy of %u bytes at 0x%X out of range", len, ctx->old_pos));
+        return kStatus_OutOfRange;
+    }
+
+    while (len > 0)
+    {
+        uint32_t chunk = MIN(len, sizeof(ctx->copy_buf));
+
+        if (bl_flash_read(ctx->old_base + ctx->old_pos, ctx->copy_buf, chunk) != 0)
+        {
+            LogError(("%s: flash read failed at 0x%X", __func__, ctx->old_base + ctx->old_pos));
+            return kStatus_Fail;
+        }
+
+        status = slot_writer_write(&ctx->writer, (const uint8_t *)ctx->copy_buf, chunk);
+        if (status != kStatus_Success)
+            return status;
+
+        ctx->old_pos += chunk;
+        ctx->produced += chunk;
+        len -= chunk;
+    }
+
+    return kStatus_Success;
+}
+
+/* Check the delta header against the update slot and the running image */
+static status_t delta_check_header(delta_apply_t *ctx)
+{
+    uint8_t digest[BL_SHA256_DIGEST_SIZE];
+
+    if (ctx->hdr.magic != DELTA_MAGIC)
+    {
+        LogError(("Invalid delta magic 0x%X", ctx->hdr.magic));
+        return kStatus_Fail;
+    }
+
+    if (ctx->hdr.new_size > ctx->writer.ptn.size || ctx->hdr.old_size > ctx->writer.ptn.size)
+    {
+        LogError(("Delta image sizes %u/%u exceed slot size", ctx->hdr.old_size, ctx->hdr.new_size));
+        return kStatus_OutOfRange;
+    }
+
+    if (bl_get_image_digest(ctx->old_base, digest) != kStatus_Success ||
+        memcmp(digest, ctx->hdr.old_digest, sizeof(digest)) != 0)
+    {
+        LogError(("Delta was not generated against the running image"));
+        return kStatus_Fail;
+    }
+
+    LogInfo(("Applying delta: %u bytes image from %u bytes image", ctx->hdr.new_size, ctx->hdr.old_size));
+    return kStatus_Success;
+}
+
+/** Prepare rebuilding an image into the slot returned by bl_get_update_partition_info(),
+ *  from a delta against the image in the active slot
+ *
+ * @retval kStatus_Success: all OK
+ *         otherwise the update slot is not available
+ */
+status_t delta_apply_init(delta_apply_t *ctx)
+{
+    status_t status;
+
+    memset(ctx, 0, sizeof(*ctx));
+
+    status = slot_writer_init(&ctx->writer);
+    if (status != kStatus_Success)
+        return status;
+
+    ctx->old_base = partition_slot(0, get_active_image())->offset;
+    ctx->state    = kDeltaState_Header;
+    return kStatus_Success;
+}
+
+/** Feed the next chunk of the delta, of any size. Copies and inserted data
+ *  are written to the update slot as soon as they are known.
+ *
+ * @retval kStatus_Success: all OK so far
+ *         otherwise the delta is invalid or writing failed
+ */
+status_t delta_apply_write(delta_apply_t *ctx, const uint8_t *data, uint32_t len)
+{
+    status_t status;
+    uint32_t n;
+
+    while (ctx->status == kStatus_Success && len > 0)
+    {
+        n      = 1;
+        status = kStatus_Success;
+
+        switch (ctx->state)
+        {
+            case kDeltaState_Header:
+                n = MIN(len, sizeof(ctx->hdr) - ctx->received);
+                memcpy((uint8_t *)&ctx->hdr + ctx->received, data, n);
+                if (ctx->received + n == sizeof(ctx->hdr))
+                {
+                    status     = delta_check_header(ctx);
+                    ctx->state = kDeltaState_Op;
+                }
+                break;
+
+            case kDeltaState_Op:
+                ctx->varint       = 0;
+                ctx->varint_shift = 0;
+                if (data[0] == DELTA_OP_COPY)
+                    ctx->state = kDeltaState_CopyLen;
+                else if (data[0] == DELTA_OP_INSERT)
+                    ctx->state = kDeltaState_InsertLen;
+                else
+                {
+                    LogError(("Invalid delta operation 0x%X at offset %u", data[0], ctx->received));
+                    status = kStatus_Fail;
+                }
+                break;
+
+            case kDeltaState_CopyLen:
+                status = delta_varint_feed(ctx, data[0]);
+                if (status == kStatus_Success)
+                {
+                    ctx->op_len       = ctx->varint;
+                    ctx->varint       = 0;
+                    ctx->varint_shift = 0;
+                    ctx->state        = kDeltaState_CopyOffset;
+                }
+                break;
+
+            case kDeltaState_CopyOffset:
+                status = delta_varint_feed(ctx, data[0]);
+                if (status == kStatus_Success)
+                {
+                    /* zigzag decoding of the signed offset */
+                    ctx->old_pos += (ctx->varint >> 1) ^ (0U - (ctx->varint & 1));
+                    status     = delta_copy(ctx, ctx->op_len);
+                    ctx->state = kDeltaState_Op;
+                }
+                break;
+
+            case kDeltaState_InsertLen:
+                status = delta_varint_feed(ctx, data[0]);
+                if (status == kStatus_Success)
+                {
+                    ctx->op_len = ctx->varint;
+                    if (ctx->op_len > ctx->hdr.new_size - ctx->produced)
+                    {
+                        LogError(("Delta insert of %u bytes exceeds image size", ctx->op_len));
+                        status = kStatus_OutOfRange;
+                    }
+                    ctx->state = ctx->op_len > 0 ? kDeltaState_InsertData : kDeltaState_Op;
+                }
+                break;
+
+            case kDeltaState_InsertData:
+                n      = MIN(len, ctx->op_len);
+                status = slot_writer_write(&ctx->writer, data, n);
+                ctx->produced += n;
+                ctx->op_len -= n;
+                if (ctx->op_len == 0)
+                    ctx->state = kDeltaState_Op;
+                break;
+        }
+
+        if (status == kStatus_Busy)
+            status = kStatus_Success;
+        ctx->status = status;
+
+        ctx->received += n;
+        data += n;
+        len -= n;
+    }
+
+    return ctx->status;
+}
+
+/** Complete the image once the whole delta was fed, see slot_writer_finish()
+ *
+ * @retval kStatus_Success: image is rebuilt and valid
+ *         otherwise something failed
+ */
+status_t delta_apply_finish(delta_apply_t *ctx)
+{
+    if (ctx->status != kStatus_Success)
+        return ctx->status;
+
+    if (ctx->state != kDeltaState_Op || ctx->produced != ctx->hdr.new_size)
+    {
+        LogError(("Truncated delta, %u of %u bytes produced", ctx->produced, ctx->hdr.new_size));
+        return kStatus_Fail;
+    }
+
+    return slot_writer_finish(&ctx->writer);
+}
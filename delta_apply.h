@@ -0,0 +1,61 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef __DELTA_APPLY_H__
+#define __DELTA_APPLY_H__
+
+#include "fsl_common.h"
+#include "slot_writer.h"
+
+/*
+ * Delta image format, as produced by armgcc/mkdelta.py (all fields little endian):
+ *
+ *   delta_header_t
+ *   operations, until new_size bytes have been produced:
+ *     DELTA_OP_COPY   varint length, zigzag varint offset from the end of the previous copy
+ *                     copies length bytes of the old (active) image
+ *     DELTA_OP_INSERT varint length, followed by length bytes of new data
+ *
+ * Varints are LEB128 encoded, 7 bits per byte, least significant group first.
+ */
+#define DELTA_MAGIC     0x4c444b41 /* "AKDL" */
+#define DELTA_OP_COPY   0x01
+#define DELTA_OP_INSERT 0x02
+
+/* Size of the bounce buffer used to copy from the old image */
+#define DELTA_COPY_CHUNK_SIZE 512
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t old_size;                           /* size of the old image, TLVs included */
+    uint32_t new_size;                           /* size of the new image, TLVs included */
+    uint8_t old_digest[BL_SHA256_DIGEST_SIZE];   /* SHA256 TLV of the old image */
+} delta_header_t;
+
+/* Rebuilds an image into the candidate slot from a delta against the active one */
+typedef struct
+{
+    slot_writer_t writer;
+    delta_header_t hdr;
+    uint32_t old_base;  /* physical offset of the active slot */
+    uint32_t old_pos;   /* old image offset following the previous copy */
+    uint32_t received;  /* delta bytes received so far */
+    uint32_t produced;  /* new image bytes written so far */
+    uint32_t state;
+    uint32_t varint;
+    uint32_t varint_shift;
+    uint32_t op_len;
+    status_t status;
+    uint32_t copy_buf[DELTA_COPY_CHUNK_SIZE / sizeof(uint32_t)];
+} delta_apply_t;
+
+status_t delta_apply_init(delta_apply_t *ctx);
+status_t delta_apply_write(delta_apply_t *ctx, const uint8_t *data, uint32_t len);
+status_t delta_apply_finish(delta_apply_t *ctx);
+
+#endif
@@ -0,0 +1,243 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "logging_levels.h"
+#define LIBRARY_LOG_NAME "dl_progress"
+#define LIBRARY_LOG_LEVEL LOG_INFO
+#include "logging_stack.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "download_progress.h"
+#include "partition_table.h"
+#include "flexspi_flash_config.h"
+
+/* the partition table always describes the record area */
+#define DL_PROGRESS_OFFSET        (partition_get(kPartitionType_Storage, kPartitionStorage_DlProgress, 0)->offset)
+#define DL_PROGRESS_LOG_OFFSET    (DL_PROGRESS_OFFSET + MFLASH_PAGE_SIZE)
+
+static uint32_t dl_progress_header_crc(const dl_progress_header_t *hdr)
+{
+    return bl_crc32(hdr, offsetof(dl_progress_header_t, crc));
+}
+
+/* Read the record header, returning false if there is no valid record */
+static bool dl_progress_read_header(dl_progress_header_t *hdr)
+{
+    if (bl_flash_read(DL_PROGRESS_OFFSET, hdr, sizeof(*hdr)) != 0)
+        return false;
+
+    return hdr->magic == DL_PROGRESS_MAGIC && hdr->crc == dl_progress_header_crc(hdr);
+}
+
+/* Program one page of the record */
+static status_t dl_progress_program(uint32_t offset, const void *data, uint32_t len)
+{
+    uint32_t page[MFLASH_PAGE_SIZE / sizeof(uint32_t)];
+    status_t status;
+
+    memset(page, 0xff, sizeof(page));
+    memcpy(page, data, len);
+
+    status = flexspi_nor_flash_program(UPDATE_EXAMPLE_FLEXSPI, offset, page, MFLASH_PAGE_SIZE);
+    sfw_flash_written(offset, MFLASH_PAGE_SIZE);
+    return status;
+}
+
+/* Append an entry to the log, programming the page holding it over its
+ * current content, which only clears the bits of the new entry */
+static status_t dl_progress_log(dl_progress_t *dl, uint32_t sectors)
+{
+    uint32_t page[MFLASH_PAGE_SIZE / sizeof(uint32_t)];
+    uint32_t offset = DL_PROGRESS_LOG_OFFSET + dl->entry * sizeof(uint32_t);
+    uint32_t index  = (offset % MFLASH_PAGE_SIZE) / sizeof(uint32_t);
+    status_t status;
+
+    offset -= offset % MFLASH_PAGE_SIZE;
+    if (index == 0)
+        memset(page, 0xff, sizeof(page));
+    else if (bl_flash_read(offset, page, sizeof(page)) != 0)
+        return kStatus_Fail;
+    page[index] = DL_PROGRESS_ENTRY(sectors);
+
+    status = flexspi_nor_flash_program(UPDATE_EXAMPLE_FLEXSPI, offset, page, MFLASH_PAGE_SIZE);
+    sfw_flash_written(offset, MFLASH_PAGE_SIZE);
+    if (status == kStatus_Success)
+        dl->entry++;
+    return status;
+}
+
+/* Number of sectors committed according to the log, and first free entry */
+static uint32_t dl_progress_read_log(uint32_t *entry)
+{
+    uint32_t words[MFLASH_PAGE_SIZE / sizeof(uint32_t)];
+    uint32_t sectors = 0;
+    uint32_t i;
+
+    for (*entry = 0; *entry < DL_PROGRESS_LOG_ENTRIES; (*entry)++)
+    {
+        i = *entry % ARRAY_SIZE(words);
+        if (i == 0 && bl_flash_read(DL_PROGRESS_LOG_OFFSET + *entry * sizeof(uint32_t), words, sizeof(words)) != 0)
+            break;
+
+        if (words[i] == 0xffffffff)
+            break;
+
+        /* a torn entry is skipped, the previous one still holds */
+        if (DL_PROGRESS_ENTRY_VALID(words[i]) && DL_PROGRESS_ENTRY_SECTORS(words[i]) > sectors)
+            sectors = DL_PROGRESS_ENTRY_SECTORS(words[i]);
+    }
+
+    return sectors;
+}
+
+/** Drop the download progress record, the next download starts from scratch */
+void dl_progress_discard(void)
+{
+    dl_progress_header_t hdr;
+
+    /* avoid wearing the sector when there is nothing to drop */
+    if (bl_flash_read(DL_PROGRESS_OFFSET, &hdr, sizeof(hdr)) == 0 && hdr.magic == 0xffffffff)
+        return;
+
+    if (flexspi_nor_flash_erase_sector(UPDATE_EXAMPLE_FLEXSPI, DL_PROGRESS_OFFSET) != kStatus_Success)
+        LogError(("%s: failed to erase progress record", __func__));
+    sfw_flash_written(DL_PROGRESS_OFFSET, MFLASH_SECTOR_SIZE);
+}
+
+/** Drop the download progress record if it targets another slot than the
+ *  given update slot, i.e. the active slot changed since it was written.
+ *  Only checked once per boot, the active slot cannot change before reboot.
+ */
+void dl_progress_check_slot(uint32_t slot_start)
+{
+    static bool checked;
+    dl_progress_header_t hdr;
+
+    if (checked)
+        return;
+    checked = true;
+
+    if (dl_progress_read_header(&hdr) && hdr.slot_start != slot_start)
+    {
+        LogInfo(("Active slot changed, dropping download progress record"));
+        dl_progress_discard();
+    }
+}
+
+/** Prepare downloading a target into the update slot, resuming a previous
+ *  download of the same target if its progress was recorded.
+ *  The download has to continue from dl_progress_resume_offset().
+ *
+ * @param digest SHA256 of the target, identifies the download
+ * @param size size of the target
+ *
+ * @retval kStatus_Success: all OK
+ *         otherwise something failed
+ */
+status_t dl_progress_start(dl_progress_t *dl, const uint8_t digest[BL_SHA256_DIGEST_SIZE], uint32_t size)
+{
+    status_t status;
+    uint32_t sectors;
+
+    memset(dl, 0, sizeof(*dl));
+
+    status = slot_writer_init(&dl->writer);
+    if (status != kStatus_Success)
+        return status;
+
+    if (size > dl->writer.ptn.size)
+        return kStatus_OutOfRange;
+
+    if (dl_progress_read_header(&dl->hdr) && dl->hdr.slot_start == dl->writer.ptn.start && dl->hdr.size == size &&
+        memcmp(dl->hdr.digest, digest, BL_SHA256_DIGEST_SIZE) == 0)
+    {
+        /* sectors are written in order, resume after the last one committed */
+        sectors = MIN(dl_progress_read_log(&dl->entry), size / MFLASH_SECTOR_SIZE);
+
+        status = slot_writer_resume(&dl->writer, sectors * MFLASH_SECTOR_SIZE);
+        if (status == kStatus_Success)
+        {
+            dl->committed = sectors * MFLASH_SECTOR_SIZE;
+            LogInfo(("Resuming download of %lu bytes at offset %lu", size, dl->committed));
+            return kStatus_Success;
+        }
+
+        /* start over if the written part cannot be taken over */
+        status = slot_writer_init(&dl->writer);
+        if (status != kStatus_Success)
+            return status;
+    }
+
+    dl_progress_discard();
+
+    dl->hdr.magic      = DL_PROGRESS_MAGIC;
+    dl->hdr.slot_start = dl->writer.ptn.start;
+    dl->hdr.size       = size;
+    memcpy(dl->hdr.digest, digest, BL_SHA256_DIGEST_SIZE);
+    dl->hdr.crc = dl_progress_header_crc(&dl->hdr);
+
+    return dl_progress_program(DL_PROGRESS_OFFSET, &dl->hdr, sizeof(dl->hdr));
+}
+
+/** Offset in the target from which the download has to continue */
+uint32_t dl_progress_resume_offset(const dl_progress_t *dl)
+{
+    return dl->committed;
+}
+
+/** Write the next chunk of the target, recording each sector once it is programmed
+ *
+ * @retval kStatus_Success: all OK so far
+ *         otherwise writing failed or the image is invalid
+ */
+status_t dl_progress_write(dl_progress_t *dl, const uint8_t *data, uint32_t len)
+{
+    uint32_t programmed;
+    status_t status;
+
+    status = slot_writer_write(&dl->writer, data, len);
+    if (status != kStatus_Success)
+        return status;
+
+    programmed = (dl->writer.written - dl->writer.sector_fill) & ~(MFLASH_SECTOR_SIZE - 1);
+    if (programmed <= dl->committed)
+        return kStatus_Success;
+
+    /* once the log is full, start a new record holding the current progress */
+    if (dl->entry == DL_PROGRESS_LOG_ENTRIES)
+    {
+        dl_progress_discard();
+        dl->entry = 0;
+        status    = dl_progress_program(DL_PROGRESS_OFFSET, &dl->hdr, sizeof(dl->hdr));
+        if (status != kStatus_Success)
+            return status;
+    }
+
+    status = dl_progress_log(dl, programmed / MFLASH_SECTOR_SIZE);
+    if (status == kStatus_Success)
+        dl->committed = programmed;
+
+    return status;
+}
+
+/** Complete the image and drop the progress record, see slot_writer_finish()
+ *
+ * @retval kStatus_Success: image is written and valid
+ *         otherwise something failed
+ */
+status_t dl_progress_finish(dl_progress_t *dl)
+{
+    status_t status = slot_writer_finish(&dl->writer);
+
+    /* a complete but invalid image will not get better by resuming */
+    if (status == kStatus_Success || dl->writer.written == dl->hdr.size)
+        dl_progress_discard();
+
+    return status;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef __DOWNLOAD_PROGRESS_H__
+#define __DOWNLOAD_PROGRESS_H__
+
+#include "fsl_common.h"
+#include "slot_writer.h"
+
+/*
+ * Persistent progress of an image download, so that it can be resumed after
+ * a connection loss or a reboot with an HTTP Range request.
+ *
+ * The record lives in the kPartitionStorage_DlProgress partition, the
+ * BOOT_FLASH_DL_PROGRESS sector by default: a header in the first page,
+ * identifying the target and the slot being written, followed by a log of the
+ * bytes committed to flash. A word is appended each time sectors of the slot
+ * are complete and never programmed again, so the sector is erased once per
+ * download, and each page is programmed at most once per word it holds.
+ *
+ * There are no per sector written or verified flags: sectors are written in
+ * order, and on resume the committed part is read back and hashed again by
+ * the slot writer, whose final SHA256 check covers it.
+ */
+#define DL_PROGRESS_MAGIC       0x50444b41 /* "AKDP" */
+#define DL_PROGRESS_LOG_ENTRIES ((MFLASH_SECTOR_SIZE - MFLASH_PAGE_SIZE) / sizeof(uint32_t))
+
+/* Log entry: number of complete sectors, and its complement to tell torn writes apart */
+#define DL_PROGRESS_ENTRY(sectors)   (((uint32_t)(sectors) << 16) | (~(uint32_t)(sectors) & 0xffffU))
+#define DL_PROGRESS_ENTRY_VALID(e)   (((e) >> 16) == (~(e) & 0xffffU))
+#define DL_PROGRESS_ENTRY_SECTORS(e) ((e) >> 16)
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t slot_start;                     /* physical offset of the slot being written */
+    uint32_t size;                           /* size of the target */
+    uint8_t digest[BL_SHA256_DIGEST_SIZE];   /* SHA256 of the target, as listed in its metadata */
+    uint32_t crc;                            /* CRC32 of the fields above */
+} dl_progress_header_t;
+
+typedef struct
+{
+    slot_writer_t writer;
+    dl_progress_header_t hdr;
+    uint32_t committed; /* target bytes recorded as written in flash */
+    uint32_t entry;     /* next free log entry */
+} dl_progress_t;
+
+status_t dl_progress_start(dl_progress_t *dl, const uint8_t digest[BL_SHA256_DIGEST_SIZE], uint32_t size);
+uint32_t dl_progress_resume_offset(const dl_progress_t *dl);
+status_t dl_progress_write(dl_progress_t *dl, const uint8_t *data, uint32_t len);
+status_t dl_progress_finish(dl_progress_t *dl);
+
+void dl_progress_discard(void);
+void dl_progress_check_slot(uint32_t slot_start);
+
+#endif
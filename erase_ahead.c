@@ -0,0 +1,415 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*
+ * Erases the update slot ahead of time: ERASE_AHEAD_SECTORS sectors in front
+ * of the slot writer during a download, and the whole slot, with block erases
+ * where possible, once a new image is confirmed and the slot content is not
+ * needed any more.
+ *
+ * Sectors known to be blank are tracked, and sectors are checked for blankness
+ * before being erased, so blank flash is never erased again.
+ *
+ * With AKNANO_SLOT_WRITER_SKIP_UNCHANGED, the slot writer only erases sectors once it
+ * knows their new content, and no slot is erased in advance: there is no erase
+ * task, only the blank sector tracking is used.
+ */
+
+#include "logging_levels.h"
+#define LIBRARY_LOG_NAME "erase_ahead"
+#define LIBRARY_LOG_LEVEL LOG_INFO
+#include "logging_stack.h"
+
+#include <string.h>
+
+#include "erase_ahead.h"
+#include "flexspi_flash_config.h"
+#include "mcuboot_app_support.h"
+#include "mflash_drv.h"
+#include "partition_table.h"
+#include "slot_writer.h"
+
+#ifndef AKNANO_HOST_BUILD
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
+
+#define ERASE_AHEAD_TASK_PRIORITY   (tskIDLE_PRIORITY + 1)
+#define ERASE_AHEAD_TASK_STACK_SIZE (configMINIMAL_STACK_SIZE * 4)
+
+static SemaphoreHandle_t erase_lock;
+static TaskHandle_t erase_task;
+
+#define ERASE_LOCK()   xSemaphoreTake(erase_lock, portMAX_DELAY)
+#define ERASE_UNLOCK() xSemaphoreGive(erase_lock)
+#define ERASE_WAKE()                  \
+    do                                \
+    {                                 \
+        if (erase_task != NULL)       \
+            xTaskNotifyGive(erase_task); \
+    } while (0)
+#else
+/* host builds have no scheduler, pending work is done by erase_ahead_run() */
+#define ERASE_LOCK()
+#define ERASE_UNLOCK()
+#define ERASE_WAKE()
+#endif
+
+/* Sectors tracked, from the first application slot, enough for the default layout */
+#define SLOTS_SECTORS ((FLASH_AREA_IMAGE_3_OFFSET - FLASH_AREA_IMAGE_1_OFFSET) / MFLASH_SECTOR_SIZE)
+
+/* One bit per sector of both slots, set when the sector is known to be blank */
+static uint32_t blank_map[SLOTS_SECTORS / 32];
+static uint32_t slots_offset = 0xffffffff;
+
+/* Slot being written, and how far */
+static uint32_t writer_start;
+static uint32_t writer_end;
+static uint32_t writer_pos;   /* sectors below were erased by the writer itself */
+static uint32_t ahead_target; /* sectors below should be erased */
+static bool writer_active;
+
+/* Whole update slot erase, requested once an image is confirmed */
+static bool slot_erase_pending;
+
+static uint32_t check_buf[MFLASH_PAGE_SIZE / sizeof(uint32_t)];
+
+static bool in_slots(uint32_t offset)
+{
+    if (slots_offset == 0xffffffff)
+        slots_offset = MIN(partition_slot(0, PARTITION_SLOT_PRIMARY)->offset,
+                           partition_slot(0, PARTITION_SLOT_SECONDARY)->offset);
+
+    /* sectors out of the map are never known to be blank */
+    return offset >= slots_offset && (offset - slots_offset) / MFLASH_SECTOR_SIZE < SLOTS_SECTORS;
+}
+
+static uint32_t sector_index(uint32_t offset)
+{
+    return (offset - slots_offset) / MFLASH_SECTOR_SIZE;
+}
+
+static void set_blank(uint32_t offset, bool blank)
+{
+    uint32_t i;
+
+    if (!in_slots(offset))
+        return;
+
+    i = sector_index(offset);
+    if (blank)
+        blank_map[i / 32] |= 1U << (i % 32);
+    else
+        blank_map[i / 32] &= ~(1U << (i % 32));
+}
+
+static bool known_blank(uint32_t offset)
+{
+    uint32_t i;
+
+    if (!in_slots(offset))
+        return false;
+
+    i = sector_index(offset);
+    return (blank_map[i / 32] & (1U << (i % 32))) != 0;
+}
+
+/* Read the sector back to find out if it is blank, recording the result */
+static bool check_blank(uint32_t offset)
+{
+    uint32_t pos;
+    uint32_t i;
+
+    for (pos = 0; pos < MFLASH_SECTOR_SIZE; pos += sizeof(check_buf))
+    {
+        if (bl_flash_read(offset + pos, check_buf, sizeof(check_buf)) != 0)
+            return false;
+
+        for (i = 0; i < ARRAY_SIZE(check_buf); i++)
+        {
+            if (check_buf[i] != 0xffffffff)
+            {
+                set_blank(offset, false);
+                return false;
+            }
+        }
+    }
+
+    set_blank(offset, true);
+    return true;
+}
+
+/* Erase a sector known not to be blank, with the lock held */
+static status_t erase_dirty_sector_locked(uint32_t offset)
+{
+    status_t status;
+
+    status = flexspi_nor_flash_erase_sector(UPDATE_EXAMPLE_FLEXSPI, offset);
+    sfw_flash_written(offset, MFLASH_SECTOR_SIZE);
+    if (status != kStatus_Success)
+    {
+        LogError(("%s: failed to erase sector at 0x%X", __func__, offset));
+        return status;
+    }
+
+    set_blank(offset, true);
+    return kStatus_Success;
+}
+
+/* Erase a sector unless it is blank already, with the lock held */
+static status_t erase_sector_locked(uint32_t offset)
+{
+    if (check_blank(offset))
+        return kStatus_Success;
+
+    return erase_dirty_sector_locked(offset);
+}
+
+/* Erase the block starting at offset, or its non blank sectors, with the lock held */
+static status_t erase_block_locked(uint32_t offset)
+{
+    uint32_t dirty = 0;
+    uint32_t pos;
+    status_t status;
+
+    for (pos = 0; pos < FLASH_BLOCK_SIZE; pos += MFLASH_SECTOR_SIZE)
+    {
+        if (!known_blank(offset + pos) && !check_blank(offset + pos))
+            dirty++;
+    }
+
+    if (dirty == 0)
+        return kStatus_Success;
+
+    if (dirty < ERASE_AHEAD_BLOCK_THRESHOLD)
+    {
+        for (pos = 0; pos < FLASH_BLOCK_SIZE; pos += MFLASH_SECTOR_SIZE)
+        {
+            if (!known_blank(offset + pos))
+            {
+                status = erase_sector_locked(offset + pos);
+                if (status != kStatus_Success)
+                    return status;
+            }
+        }
+        return kStatus_Success;
+    }
+
+    status = flexspi_nor_flash_erase_block(UPDATE_EXAMPLE_FLEXSPI, offset);
+    sfw_flash_written(offset, FLASH_BLOCK_SIZE);
+    if (status != kStatus_Success)
+    {
+        LogError(("%s: failed to erase block at 0x%X: %d%s", __func__, offset, status,
+                  status == kStatus_Timeout ? " (timeout)" : ""));
+        return status;
+    }
+
+    for (pos = 0; pos < FLASH_BLOCK_SIZE; pos += MFLASH_SECTOR_SIZE)
+        set_blank(offset + pos, true);
+
+    return kStatus_Success;
+}
+
+/* Do one step of the pending work, returning false when there is nothing left to do */
+static bool erase_ahead_step(void)
+{
+    partition_t ptn;
+    uint32_t offset;
+    status_t status;
+    bool more = true;
+
+    ERASE_LOCK();
+
+    if (writer_active)
+    {
+        /* sectors in front of the writer, which has not reached them yet */
+        for (offset = writer_pos; offset < ahead_target && known_blank(offset); offset += MFLASH_SECTOR_SIZE)
+            ;
+
+        /* on failure, leave the sector to the writer, which reports the error */
+        if (offset < ahead_target && erase_sector_locked(offset) != kStatus_Success)
+            writer_pos = offset + MFLASH_SECTOR_SIZE;
+        else if (offset >= ahead_target)
+            more = false;
+    }
+    else if (slot_erase_pending)
+    {
+        more = false;
+        if (bl_get_update_partition_info(&ptn) == kStatus_Success)
+        {
+            for (offset = ptn.start; offset < ptn.start + ptn.size; offset += MFLASH_SECTOR_SIZE)
+            {
+                if (!known_blank(offset))
+                    break;
+            }
+
+            if (offset < ptn.start + ptn.size)
+            {
+                if (FLASH_BLOCK_SIZE != 0 && offset % FLASH_BLOCK_SIZE == 0 &&
+                    offset + FLASH_BLOCK_SIZE <= ptn.start + ptn.size)
+                    status = erase_block_locked(offset);
+                else
+                    status = erase_sector_locked(offset);
+
+                /* the header of the image in the slot is gone */
+                bl_invalidate_image_state();
+
+                /* not retried forever, the slot writer erases what it needs */
+                more = status == kStatus_Success;
+                if (!more)
+                    LogError(("Giving up erasing update slot at 0x%X", offset));
+            }
+            else
+                LogInfo(("Update slot at 0x%X is blank", ptn.start));
+        }
+
+        slot_erase_pending = more;
+    }
+    else
+        more = false;
+
+    ERASE_UNLOCK();
+    return more;
+}
+
+/** Do all the pending erase work. Called by the erase task, or directly when
+ *  there is no scheduler.
+ */
+void erase_ahead_run(void)
+{
+    while (erase_ahead_step())
+    {
+#ifndef AKNANO_HOST_BUILD
+        /* let the writer get the lock between erases */
+        taskYIELD();
+#endif
+    }
+}
+
+#if !defined(AKNANO_HOST_BUILD) && !defined(AKNANO_SLOT_WRITER_SKIP_UNCHANGED)
+static void erase_ahead_task(void *pvParameters)
+{
+    (void)pvParameters;
+
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        erase_ahead_run();
+    }
+}
+#endif
+
+/** Create the erase task, to be called once before the scheduler starts */
+void erase_ahead_init(void)
+{
+#ifndef AKNANO_HOST_BUILD
+    erase_lock = xSemaphoreCreateMutex();
+    if (erase_lock == NULL)
+    {
+        LogError(("%s: failed to create erase lock", __func__));
+        return;
+    }
+
+#ifndef AKNANO_SLOT_WRITER_SKIP_UNCHANGED
+    if (xTaskCreate(erase_ahead_task, "erase_ahead", ERASE_AHEAD_TASK_STACK_SIZE, NULL, ERASE_AHEAD_TASK_PRIORITY,
+                    &erase_task) != pdPASS)
+        LogError(("%s: failed to create erase task", __func__));
+#endif
+#endif
+}
+
+/** Erase a slot sector, unless it is blank already.
+ *
+ * @param dirty the caller read the sector and found it is not blank, it is
+ *        erased without being read back
+ *
+ * @retval kStatus_Success: the sector is blank
+ *         otherwise erase failed
+ */
+status_t erase_ahead_erase_sector(uint32_t offset, bool dirty)
+{
+    status_t status;
+
+    ERASE_LOCK();
+    status = dirty ? erase_dirty_sector_locked(offset) : erase_sector_locked(offset);
+    if (writer_active && offset >= writer_start && offset < writer_end && offset + MFLASH_SECTOR_SIZE > writer_pos)
+        writer_pos = offset + MFLASH_SECTOR_SIZE;
+    ERASE_UNLOCK();
+
+    return status;
+}
+
+/** Keep the background erase from issuing flash commands, until
+ *  erase_ahead_resume(). Not to be nested.
+ */
+void erase_ahead_pause(void)
+{
+    ERASE_LOCK();
+}
+
+void erase_ahead_resume(void)
+{
+    ERASE_UNLOCK();
+}
+
+/** Record that a flash range was programmed, it is not blank any more */
+void erase_ahead_mark_written(uint32_t offset, uint32_t len)
+{
+    uint32_t pos;
+
+    ERASE_LOCK();
+    for (pos = offset - offset % MFLASH_SECTOR_SIZE; pos < offset + len; pos += MFLASH_SECTOR_SIZE)
+        set_blank(pos, false);
+    ERASE_UNLOCK();
+}
+
+/** A new image is about to be written to the given slot */
+void erase_ahead_writer_start(uint32_t slot_start, uint32_t slot_size)
+{
+    ERASE_LOCK();
+    writer_start       = slot_start;
+    writer_end         = slot_start + slot_size;
+    writer_pos         = slot_start;
+    ahead_target       = slot_start;
+    writer_active      = true;
+    slot_erase_pending = false;
+    ERASE_UNLOCK();
+}
+
+/** The writer reached the given offset, keep ERASE_AHEAD_SECTORS erased in front of it */
+void erase_ahead_writer_progress(uint32_t offset)
+{
+    ERASE_LOCK();
+    if (writer_active)
+        ahead_target = MIN(offset - offset % MFLASH_SECTOR_SIZE + (ERASE_AHEAD_SECTORS + 1) * MFLASH_SECTOR_SIZE,
+                           writer_end);
+    ERASE_UNLOCK();
+
+    ERASE_WAKE();
+}
+
+/** The writer is done, successfully or not */
+void erase_ahead_writer_stop(void)
+{
+    ERASE_LOCK();
+    writer_active = false;
+    ERASE_UNLOCK();
+}
+
+/** Erase the whole update slot in the background, once its content is not needed any more */
+void erase_ahead_request_slot_erase(void)
+{
+#ifndef AKNANO_SLOT_WRITER_SKIP_UNCHANGED
+    ERASE_LOCK();
+    slot_erase_pending = true;
+    ERASE_UNLOCK();
+
+    ERASE_WAKE();
+#else
+    /* the slot writer compares the next image with the current slot content */
+#endif
+}
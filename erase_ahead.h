@@ -0,0 +1,36 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef __ERASE_AHEAD_H__
+#define __ERASE_AHEAD_H__
+
+#include "fsl_common.h"
+
+/* Number of sectors kept erased ahead of the slot writer */
+#ifndef ERASE_AHEAD_SECTORS
+#define ERASE_AHEAD_SECTORS 8
+#endif
+
+/* Minimum number of sectors to erase in a block for a block erase to be used */
+#ifndef ERASE_AHEAD_BLOCK_THRESHOLD
+#define ERASE_AHEAD_BLOCK_THRESHOLD 4
+#endif
+
+void erase_ahead_init(void);
+void erase_ahead_run(void);
+
+status_t erase_ahead_erase_sector(uint32_t offset, bool dirty);
+void erase_ahead_pause(void);
+void erase_ahead_resume(void);
+void erase_ahead_mark_written(uint32_t offset, uint32_t len);
+
+void erase_ahead_writer_start(uint32_t slot_start, uint32_t slot_size);
+void erase_ahead_writer_progress(uint32_t offset);
+void erase_ahead_writer_stop(void);
+void erase_ahead_request_slot_erase(void);
+
+#endif
@@ -0,0 +1,394 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "logging_levels.h"
+#define LIBRARY_LOG_NAME "flash_bench"
+#define LIBRARY_LOG_LEVEL LOG_INFO
+#include "logging_stack.h"
+
+#include <stdlib.h>
+
+#include "erase_ahead.h"
+#include "flash_benchmark.h"
+#include "flexspi_flash_config.h"
+#include "mcuboot_app_support.h"
+#include "mflash_drv.h"
+#include "partition_table.h"
+
+#ifdef AKNANO_HOST_BUILD
+#include <time.h>
+#endif
+
+/* Size of the reads issued by the read benchmarks */
+#define FLASH_BENCH_READ_SIZE 4096
+
+typedef status_t (*flash_bench_op_t)(uint32_t addr, uint32_t len);
+
+typedef struct
+{
+    const char *name;
+    uint32_t offset; /* from the start of the scratch area */
+    uint32_t len;
+} flash_bench_case_t;
+
+static const flash_bench_case_t read_cases[] = {
+    {"aligned", 0, FLASH_BENCH_READ_SIZE},
+    {"unaligned", 1, FLASH_BENCH_READ_SIZE - 3},
+    {"page-crossing", MFLASH_PAGE_SIZE - 16, 64},
+};
+
+static uint32_t bench_samples[FLASH_BENCH_ITERATIONS];
+static uint32_t bench_buf[(FLASH_BENCH_READ_SIZE + MFLASH_PAGE_SIZE) / sizeof(uint32_t)];
+static uint32_t scratch_base;
+static uint32_t scratch_size;
+
+/*******************************************************************************
+ * Time measurement: DWT cycle counter on target, monotonic clock on host
+ ******************************************************************************/
+#ifdef AKNANO_HOST_BUILD
+static void bench_timer_init(void)
+{
+}
+
+static uint64_t bench_timer_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#else
+static uint64_t bench_cycles_high;
+static uint32_t bench_cycles_last;
+
+static void bench_timer_init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = 0xC5ACCE55;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    bench_cycles_high = 0;
+    bench_cycles_last = 0;
+}
+
+static uint64_t bench_timer_ns(void)
+{
+    uint32_t cycles = DWT->CYCCNT;
+
+    /* the 32 bits counter wraps every few seconds, each measured operation is much shorter */
+    if (cycles < bench_cycles_last)
+        bench_cycles_high += 1ULL << 32;
+    bench_cycles_last = cycles;
+
+    return ((bench_cycles_high | cycles) * 1000ULL) / (SystemCoreClock / 1000000U);
+}
+#endif
+
+/*******************************************************************************
+ * Measured operations
+ ******************************************************************************/
+static status_t bench_flash_read(uint32_t addr, uint32_t len)
+{
+    return bl_flash_read(addr, (uint8_t *)bench_buf + (addr & 3), len) == 0 ? kStatus_Success : kStatus_Fail;
+}
+
+static status_t bench_sfw_flash_read(uint32_t addr, uint32_t len)
+{
+    return sfw_flash_read(addr, (uint8_t *)bench_buf + (addr & 3), len);
+}
+
+static status_t bench_sfw_flash_read_ipc(uint32_t addr, uint32_t len)
+{
+    return sfw_flash_read_ipc(addr, bench_buf, len);
+}
+
+static status_t bench_sector_erase(uint32_t addr, uint32_t len)
+{
+    (void)len;
+    return mflash_drv_sector_erase(addr & ~(MFLASH_SECTOR_SIZE - 1));
+}
+
+static status_t bench_page_program(uint32_t addr, uint32_t len)
+{
+    (void)len;
+    erase_ahead_mark_written(addr, MFLASH_PAGE_SIZE);
+    return mflash_drv_page_program(addr & ~(MFLASH_PAGE_SIZE - 1), bench_buf);
+}
+
+static status_t bench_sector_program(uint32_t addr, uint32_t len)
+{
+    erase_ahead_mark_written(addr, len);
+    return flexspi_nor_flash_program(UPDATE_EXAMPLE_FLEXSPI, addr, bench_buf, len);
+}
+
+static status_t bench_wait_bus_busy(uint32_t addr, uint32_t len)
+{
+    (void)addr;
+    (void)len;
+    return flexspi_nor_wait_bus_busy(UPDATE_EXAMPLE_FLEXSPI);
+}
+
+/* OTA finalize path: image check, slot state and trailer writes */
+static status_t bench_get_image_state(uint32_t addr, uint32_t len)
+{
+    uint32_t state;
+
+    (void)addr;
+    (void)len;
+    return bl_get_image_state(&state);
+}
+
+static status_t bench_invalidate_image_state(uint32_t addr, uint32_t len)
+{
+    (void)addr;
+    (void)len;
+    bl_invalidate_image_state();
+    return kStatus_Success;
+}
+
+static status_t bench_verify_image(uint32_t addr, uint32_t len)
+{
+    (void)addr;
+    return bl_verify_image((const uint8_t *)(uintptr_t)partition_slot(0, get_active_image())->offset, len) == 1 ?
+               kStatus_Success :
+               kStatus_Fail;
+}
+
+/* the trailer of the update slot is the last sector of the scratch area */
+static status_t bench_erase_trailer(uint32_t addr, uint32_t len)
+{
+    uint32_t sector = scratch_base + scratch_size - MFLASH_SECTOR_SIZE;
+
+    (void)addr;
+    (void)len;
+    bl_invalidate_image_state();
+    return flexspi_nor_flash_erase_sector(UPDATE_EXAMPLE_FLEXSPI, sector);
+}
+
+static status_t bench_swap_test(uint32_t addr, uint32_t len)
+{
+    (void)addr;
+    (void)len;
+    return bl_update_image_state(kSwapType_ReadyForTest);
+}
+
+#ifdef AKNANO_HOST_BUILD
+/* Trailer of an image booted for test, as left by MCUboot in the running slot.
+ * Only on the emulated flash, as this reverts the confirmation of the running image. */
+static status_t bench_booted_for_test(uint32_t addr, uint32_t len)
+{
+    const partition_entry_t *slot = partition_slot(0, get_active_image());
+    uint32_t trailer[MFLASH_PAGE_SIZE / sizeof(uint32_t)];
+    struct image_trailer *t = (struct image_trailer *)((uint8_t *)trailer + MFLASH_PAGE_SIZE - sizeof(*t));
+    status_t status;
+
+    (void)addr;
+    (void)len;
+
+    memset(trailer, 0xff, sizeof(trailer));
+    memcpy(t->magic, boot_img_magic, sizeof(t->magic));
+    t->copy_done = BOOT_FLAG_SET;
+
+    bl_invalidate_image_state();
+    status = mflash_drv_sector_erase(slot->offset + slot->size - MFLASH_SECTOR_SIZE);
+    if (status == kStatus_Success)
+        status = mflash_drv_page_program(slot->offset + slot->size - MFLASH_PAGE_SIZE, trailer);
+    return status;
+}
+
+static status_t bench_swap_ok(uint32_t addr, uint32_t len)
+{
+    (void)addr;
+    (void)len;
+    return bl_update_image_state(kSwapType_Permanent);
+}
+#endif
+
+/*******************************************************************************
+ * Statistics
+ ******************************************************************************/
+static int bench_compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void bench_compute(flash_bench_result_t *result, uint32_t *samples, uint32_t count)
+{
+    uint64_t sum = 0;
+    uint32_t i;
+
+    qsort(samples, count, sizeof(samples[0]), bench_compare_u32);
+
+    memset(result->histogram, 0, sizeof(result->histogram));
+    for (i = 0; i < count; i++)
+    {
+        uint32_t us     = samples[i] / 1000;
+        uint32_t bucket = 0;
+
+        while (us > 1 && bucket < FLASH_BENCH_HISTOGRAM_BUCKETS - 1)
+        {
+            us >>= 1;
+            bucket++;
+        }
+        result->histogram[bucket]++;
+        sum += samples[i];
+    }
+
+    result->samples = count;
+    result->min_ns  = samples[0];
+    result->max_ns  = samples[count - 1];
+    result->avg_ns  = (uint32_t)(sum / count);
+    result->p99_ns  = samples[(count * 99 + 99) / 100 - 1];
+}
+
+static void bench_print(const flash_bench_result_t *result, const char *variant, uint32_t len)
+{
+    int i;
+
+    LogInfo(("%-26s %-13s %5u B: min %8u avg %8u p99 %8u max %8u ns", result->name, variant, len, result->min_ns,
+             result->avg_ns, result->p99_ns, result->max_ns));
+
+    for (i = 0; i < FLASH_BENCH_HISTOGRAM_BUCKETS; i++)
+    {
+        if (result->histogram[i] != 0)
+            LogInfo(("    < %6u us: %u", 2U << i, result->histogram[i]));
+    }
+}
+
+static status_t bench_measure(const char *name, flash_bench_op_t op, const char *variant, uint32_t offset,
+                              uint32_t len, flash_bench_op_t prepare)
+{
+    flash_bench_result_t result;
+    uint32_t i;
+    status_t status;
+
+    result.name = name;
+    for (i = 0; i < FLASH_BENCH_ITERATIONS; i++)
+    {
+        uint32_t addr = scratch_base + offset;
+        uint64_t start;
+
+        /* programs need an erased target: each iteration uses its own pages */
+        if (prepare != NULL)
+        {
+            addr += (i * MAX(len, MFLASH_PAGE_SIZE)) % (4 * MFLASH_SECTOR_SIZE);
+            status = prepare(addr, len);
+            if (status != kStatus_Success)
+                return status;
+        }
+
+        start  = bench_timer_ns();
+        status = op(addr, len);
+        bench_samples[i] = (uint32_t)(bench_timer_ns() - start);
+
+        if (status != kStatus_Success)
+        {
+            LogError(("%s %s failed at 0x%X: %d", name, variant, addr, status));
+            return status;
+        }
+    }
+
+    bench_compute(&result, bench_samples, FLASH_BENCH_ITERATIONS);
+    bench_print(&result, variant, len);
+    return kStatus_Success;
+}
+
+static status_t bench_erase_if_page_start(uint32_t addr, uint32_t len)
+{
+    (void)len;
+    if (addr % MFLASH_SECTOR_SIZE != 0)
+        return kStatus_Success;
+    return mflash_drv_sector_erase(addr);
+}
+
+status_t flash_bench_run(void)
+{
+    static const struct
+    {
+        const char *name;
+        flash_bench_op_t op;
+    } read_ops[] = {
+        {"flash_read", bench_flash_read},
+        {"sfw_flash_read", bench_sfw_flash_read},
+        {"sfw_flash_read_ipc", bench_sfw_flash_read_ipc},
+    };
+    partition_t ptn;
+    status_t status;
+    uint32_t i, j;
+
+    if (mflash_drv_init() != kStatus_Success)
+        return kStatus_Fail;
+
+    status = bl_get_update_partition_info(&ptn);
+    if (status != kStatus_Success)
+    {
+        LogError(("No update slot available for benchmarking"));
+        return status;
+    }
+    scratch_base = ptn.start;
+    scratch_size = ptn.size;
+    bl_verify_mark_verified(0, 0);
+    bl_invalidate_image_state();
+
+    bench_timer_init();
+    LogInfo(("Flash benchmark, %u iterations per operation, scratch area at 0x%X", FLASH_BENCH_ITERATIONS,
+             scratch_base));
+
+    for (i = 0; i < ARRAY_SIZE(read_ops); i++)
+    {
+        for (j = 0; j < ARRAY_SIZE(read_cases); j++)
+        {
+            /* IP command reads work on words */
+            if (read_ops[i].op == bench_sfw_flash_read_ipc && (read_cases[j].offset | read_cases[j].len) % 4 != 0)
+                continue;
+
+            status = bench_measure(read_ops[i].name, read_ops[i].op, read_cases[j].name, read_cases[j].offset,
+                                   read_cases[j].len, NULL);
+            if (status != kStatus_Success)
+                return status;
+        }
+    }
+
+    status = bench_measure("flexspi_nor_wait_bus_busy", bench_wait_bus_busy, "idle", 0, 0, NULL);
+    if (status == kStatus_Success)
+        status = bench_measure("mflash_drv_sector_erase", bench_sector_erase, "sector", 0, MFLASH_SECTOR_SIZE, NULL);
+    if (status == kStatus_Success)
+    {
+        memset(bench_buf, 0x5a, sizeof(bench_buf));
+        status = bench_measure("mflash_drv_page_program", bench_page_program, "page", 0, MFLASH_PAGE_SIZE,
+                               bench_erase_if_page_start);
+    }
+    if (status == kStatus_Success)
+        status = bench_measure("flexspi_nor_flash_program", bench_sector_program, "sector", 0, MFLASH_SECTOR_SIZE,
+                               bench_erase_if_page_start);
+
+    if (status == kStatus_Success)
+        status = bench_measure("bl_get_image_state", bench_get_image_state, "cached", 0, 0, NULL);
+    if (status == kStatus_Success)
+        status = bench_measure("bl_get_image_state", bench_get_image_state, "from flash", 0, 0,
+                               bench_invalidate_image_state);
+    if (status == kStatus_Success)
+        status = bench_measure("bl_verify_image", bench_verify_image, "running", 0,
+                               partition_slot(0, get_active_image())->size, NULL);
+    if (status == kStatus_Success)
+        status = bench_measure("boot_swap_test", bench_swap_test, "erased", 0, 0, bench_erase_trailer);
+    if (status == kStatus_Success)
+        status = bench_measure("boot_swap_test", bench_swap_test, "unchanged", 0, 0, NULL);
+#ifdef AKNANO_HOST_BUILD
+    if (status == kStatus_Success)
+        status = bench_measure("boot_swap_ok", bench_swap_ok, "journal", 0, 0, bench_booted_for_test);
+#endif
+
+    /* no swap request left behind */
+    if (bench_erase_trailer(0, 0) != kStatus_Success && status == kStatus_Success)
+        status = kStatus_Fail;
+
+    return status;
+}
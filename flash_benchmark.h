@@ -0,0 +1,39 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef __FLASH_BENCHMARK_H__
+#define __FLASH_BENCHMARK_H__
+
+#include "fsl_common.h"
+
+/* Number of samples taken for each measured operation */
+#ifndef FLASH_BENCH_ITERATIONS
+#define FLASH_BENCH_ITERATIONS 100
+#endif
+
+/* Number of power of two buckets in the latency histograms, starting at 1 us */
+#define FLASH_BENCH_HISTOGRAM_BUCKETS 16
+
+typedef struct
+{
+    const char *name;
+    uint32_t samples;
+    uint32_t min_ns;
+    uint32_t avg_ns;
+    uint32_t p99_ns;
+    uint32_t max_ns;
+    uint32_t histogram[FLASH_BENCH_HISTOGRAM_BUCKETS];
+} flash_bench_result_t;
+
+/*
+ * Measure the latency of the flash access paths used during OTA, printing
+ * min/avg/p99 and a latency histogram for each of them.
+ * The first sectors of the update slot are erased and overwritten.
+ */
+status_t flash_bench_run(void);
+
+#endif
@@ -9,13 +9,34 @@
 #define _FLASH_PARTITIONING_H_
 
 #ifdef AKNANO_BOARD_MODEL_RT1060
-#define BOOT_FLASH_BASE     0x60000000
-#define BOOT_FLASH_ACT_APP  0x60040000
-#define BOOT_FLASH_CAND_APP 0x60240000
+#define BOOT_FLASH_BASE            0x60000000
+#define BOOT_FLASH_ACT_APP         0x60040000
+#define BOOT_FLASH_CAND_APP        0x60240000
+#define BOOT_FLASH_DL_PROGRESS     0x60440000
+#define BOOT_FLASH_UPDATE_TXN      0x60441000
+#define BOOT_FLASH_WEAR_LOG        0x60443000
+#define BOOT_FLASH_PARTITION_TABLE 0x6003f000
 #else
-#define BOOT_FLASH_BASE     0x30000000
-#define BOOT_FLASH_ACT_APP  0x30040000
-#define BOOT_FLASH_CAND_APP 0x30240000
+#define BOOT_FLASH_BASE            0x30000000
+#define BOOT_FLASH_ACT_APP         0x30040000
+#define BOOT_FLASH_CAND_APP        0x30240000
+#define BOOT_FLASH_DL_PROGRESS     0x30440000
+#define BOOT_FLASH_UPDATE_TXN      0x30441000
+#define BOOT_FLASH_WEAR_LOG        0x30443000
+#define BOOT_FLASH_PARTITION_TABLE 0x3003f000
 #endif
 
+/* Download progress record (download_progress.c), one sector right after the slots */
+#define BOOT_FLASH_DL_PROGRESS_SIZE 0x1000
+
+/* Update transaction record (update_txn.c), two sectors written in turn */
+#define BOOT_FLASH_UPDATE_TXN_SIZE 0x2000
+
+/* Flash wear log (flash_wear.c), two sectors written in turn */
+#define BOOT_FLASH_WEAR_LOG_SIZE 0x2000
+
+/* Partition table (partition_table.c), optional, overrides the layout above.
+ * Last sector of the bootloader area, which does not move with the slots */
+#define BOOT_FLASH_PARTITION_TABLE_SIZE 0x1000
+
 #endif
@@ -0,0 +1,248 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "logging_levels.h"
+#define LIBRARY_LOG_NAME "flash_wear"
+#define LIBRARY_LOG_LEVEL LOG_INFO
+#include "logging_stack.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "flash_wear.h"
+#include "mcuboot_app_support.h"
+#include "mflash_drv.h"
+#include "record_log.h"
+
+/* Counters as last logged, and operations counted since then */
+static flash_wear_record_t record;
+static flash_wear_record_t pending;
+static bool pending_any;
+static record_log_t record_log = RECORD_LOG_INIT(kPartitionStorage_WearLog, FLASH_WEAR_MAGIC, flash_wear_record_t);
+static bool record_loaded;
+
+static uint32_t last_erase_us;
+static uint32_t last_program_us;
+
+/* Counter of the region holding the sector at offset, NULL for the log itself */
+static flash_wear_counter_t *flash_wear_counter(flash_wear_record_t *r, uint32_t offset)
+{
+    const partition_table_t *t = partition_table_get();
+    const partition_entry_t *e;
+    uint32_t i;
+
+    for (i = 0; i < t->count; i++)
+    {
+        e = &t->entry[i];
+        if (offset < e->offset || offset - e->offset >= e->size)
+            continue;
+
+        switch (e->type)
+        {
+            case kPartitionType_Slot:
+                if (offset - e->offset >= e->size - MFLASH_SECTOR_SIZE)
+                    return &r->trailer[e->id][e->slot];
+                return &r->slot[e->id][e->slot];
+            case kPartitionType_Storage:
+                return e->id == kPartitionStorage_WearLog ? NULL : &r->storage[e->id];
+            default:
+                return &r->other;
+        }
+    }
+
+    return &r->other;
+}
+
+/** Count an erase or program, done by the flexspi_nor_flash_* functions
+ *
+ * @param op kFlashWear_[...]
+ * @param address flash offset
+ * @param length bytes erased or programmed
+ * @param duration_us time the operation took
+ */
+void flash_wear_count(uint32_t op, uint32_t address, uint32_t length, uint32_t duration_us)
+{
+    uint32_t unit = op == kFlashWear_Erase ? MFLASH_SECTOR_SIZE : MFLASH_PAGE_SIZE;
+    flash_wear_counter_t *c;
+    uint32_t primask;
+    uint32_t off;
+
+    for (off = 0; off < length; off += unit)
+    {
+        c = flash_wear_counter(&pending, address + off);
+        if (c == NULL)
+            continue;
+
+        primask = DisableGlobalIRQ();
+        if (op == kFlashWear_Erase)
+            c->erases++;
+        else
+            c->programs++;
+        pending_any = true;
+        EnableGlobalIRQ(primask);
+    }
+
+    if (op == kFlashWear_Erase)
+        last_erase_us = duration_us;
+    else
+        last_program_us = duration_us;
+}
+
+/* Read the latest record, done once on first use */
+static void flash_wear_load(void)
+{
+    if (record_loaded)
+        return;
+    record_loaded = true;
+
+    /* counting starts over when there is no record to read */
+    memset(&record, 0, sizeof(record));
+    if (record_log_load(&record_log, &record) != kStatus_Success)
+        memset(&record, 0, sizeof(record));
+}
+
+/* Add the counters of src to those of dst, with interrupts disabled */
+static void flash_wear_add(flash_wear_record_t *dst, const flash_wear_record_t *src)
+{
+    flash_wear_counter_t *d       = &dst->slot[0][0];
+    const flash_wear_counter_t *s = &src->slot[0][0];
+    uint32_t n = (offsetof(flash_wear_record_t, crc) - offsetof(flash_wear_record_t, slot)) / sizeof(*d);
+    uint32_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        d[i].erases += s[i].erases;
+        d[i].programs += s[i].programs;
+    }
+}
+
+/* Add the operations counted since the last call to the record */
+static bool flash_wear_merge(void)
+{
+    uint32_t primask;
+    bool merged;
+
+    flash_wear_load();
+
+    primask = DisableGlobalIRQ();
+    merged  = pending_any;
+    if (merged)
+        flash_wear_add(&record, &pending);
+    memset(&pending, 0, sizeof(pending));
+    pending_any = false;
+    EnableGlobalIRQ(primask);
+
+    return merged;
+}
+
+/** Log the counters, if there were operations since they were last logged
+ *  (see record_log.h)
+ *
+ * @retval kStatus_Success: all OK
+ *         kStatus_NoData: no wear log area in the partition table
+ *         otherwise writing failed, the counters are logged next time
+ */
+status_t flash_wear_flush(void)
+{
+    status_t status;
+
+    if (!flash_wear_merge())
+        return kStatus_Success;
+
+    status = record_log_append(&record_log, &record);
+    if (status != kStatus_Success && status != kStatus_NoData)
+        pending_any = true;
+
+    return status;
+}
+
+/** Get the counters, the operations not logged yet included. These stay
+ *  pending, to be logged by the next flash_wear_flush().
+ */
+void flash_wear_get(flash_wear_t *wear)
+{
+    uint32_t primask;
+
+    flash_wear_load();
+
+    primask = DisableGlobalIRQ();
+    memcpy(&wear->counters, &record, sizeof(record));
+    if (pending_any)
+        flash_wear_add(&wear->counters, &pending);
+    EnableGlobalIRQ(primask);
+
+    wear->last_erase_us   = last_erase_us;
+    wear->last_program_us = last_program_us;
+}
+
+static int flash_wear_append(char *buf, size_t size, int len, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    if (len < 0 || (size_t)len >= size)
+        return -1;
+
+    va_start(ap, fmt);
+    n = vsnprintf(buf + len, size - len, fmt, ap);
+    va_end(ap);
+
+    return n < 0 ? -1 : len + n;
+}
+
+/** Format the counters as a JSON object, for the device report:
+ *  {"slot0.0":[erases,programs],"trailer0.0":[...],...,"storage0":[...],...,
+ *   "other":[...],"log_writes":n,"last_erase_us":n,"last_program_us":n}
+ *  Only the regions of the partition table are listed.
+ *
+ * @retval length of the string, or -1 if it does not fit
+ */
+int flash_wear_report(char *buf, size_t size)
+{
+    const flash_wear_counter_t *c;
+    flash_wear_t wear;
+    uint32_t id;
+    uint32_t slot;
+    int len = 0;
+
+    flash_wear_get(&wear);
+
+    len = flash_wear_append(buf, size, len, "{");
+    for (id = 0; id < PARTITION_MAX_IDS; id++)
+    {
+        for (slot = PARTITION_SLOT_PRIMARY; slot <= PARTITION_SLOT_SECONDARY; slot++)
+        {
+            if (partition_slot(id, slot) == NULL)
+                continue;
+
+            c   = &wear.counters.slot[id][slot];
+            len = flash_wear_append(buf, size, len, "\"slot%lu.%lu\":[%lu,%lu],", id, slot, c->erases, c->programs);
+            c   = &wear.counters.trailer[id][slot];
+            len = flash_wear_append(buf, size, len, "\"trailer%lu.%lu\":[%lu,%lu],", id, slot, c->erases,
+                                    c->programs);
+        }
+    }
+
+    for (id = 0; id < PARTITION_MAX_IDS; id++)
+    {
+        if (id == kPartitionStorage_WearLog || partition_get(kPartitionType_Storage, id, 0) == NULL)
+            continue;
+
+        c   = &wear.counters.storage[id];
+        len = flash_wear_append(buf, size, len, "\"storage%lu\":[%lu,%lu],", id, c->erases, c->programs);
+    }
+
+    c   = &wear.counters.other;
+    len = flash_wear_append(buf, size, len, "\"other\":[%lu,%lu],\"log_writes\":%lu,", c->erases, c->programs,
+                            wear.counters.seq);
+    len = flash_wear_append(buf, size, len, "\"last_erase_us\":%lu,\"last_program_us\":%lu}", wear.last_erase_us,
+                            wear.last_program_us);
+
+    return len < 0 || (size_t)len >= size ? -1 : len;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef __FLASH_WEAR_H__
+#define __FLASH_WEAR_H__
+
+#include "fsl_common.h"
+#include "partition_table.h"
+
+/*
+ * Flash wear telemetry: sectors erased and pages programmed in each region of
+ * the flash (image slots, their trailer sector, storage areas), and duration
+ * of the last erase and program.
+ *
+ * Operations are counted by the flexspi_nor_flash_* functions. Counters are
+ * kept in a log in the kPartitionStorage_WearLog partition by
+ * flash_wear_flush(), to be called now and then, e.g. once per polling cycle,
+ * so that the log does not wear the flash much itself. Its own writes are not
+ * counted: its seq is the number of pages it programmed.
+ */
+#define FLASH_WEAR_MAGIC 0x4c574b41 /* "AKWL" */
+
+enum
+{
+    kFlashWear_Erase,
+    kFlashWear_Program,
+};
+
+typedef struct
+{
+    uint32_t erases;   /* sectors erased, block erases counting as their sectors */
+    uint32_t programs; /* pages programmed */
+} flash_wear_counter_t;
+
+/* As stored in flash, one record per page, the one with the highest seq wins */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t seq;
+    flash_wear_counter_t slot[PARTITION_MAX_IDS][2];    /* image slots but their last sector */
+    flash_wear_counter_t trailer[PARTITION_MAX_IDS][2]; /* last sector of the image slots */
+    flash_wear_counter_t storage[PARTITION_MAX_IDS];    /* by kPartitionStorage_[...] */
+    flash_wear_counter_t other;                         /* rest of the flash */
+    uint32_t crc;                                       /* CRC32 of the fields above */
+} flash_wear_record_t;
+
+typedef struct
+{
+    flash_wear_record_t counters;
+    uint32_t last_erase_us;   /* since boot, 0 if none */
+    uint32_t last_program_us; /* per page */
+} flash_wear_t;
+
+void flash_wear_count(uint32_t op, uint32_t address, uint32_t length, uint32_t duration_us);
+status_t flash_wear_flush(void);
+void flash_wear_get(flash_wear_t *wear);
+int flash_wear_report(char *buf, size_t size);
+
+/* Hook of the device report of the aknano client (aknano_client.c): the
+ * counters as formatted by flash_wear_report() */
+int aknano_cli_get_flash_wear_report(char *buf, size_t size);
+
+#endif
@@ -17,14 +17,71 @@
 /*${macro:start}*/
 #define FLASH_PAGE_SIZE                 256
 #define SECTOR_SIZE                     0x1000 /* 4K */
+
+/* Block erase (0xD8) size, supported by the NOR flash of both EVKs. Set to 0 if
+ * the flash has no block erase, so that only sector erases are used */
+#ifndef FLASH_BLOCK_SIZE
+#define FLASH_BLOCK_SIZE                0x10000 /* 64K */
+#endif
+
+/* Longest program or erase of the NOR flash of both EVKs (64K block erase,
+ * 2 s at most), with margin */
+#ifndef FLASH_BUSY_TIMEOUT_US
+#define FLASH_BUSY_TIMEOUT_US           4000000
+#endif
+
+/* Erase time after which an erase is suspended, when the application runs
+ * from the flash, so that interrupts and other tasks run meanwhile. 0 to never
+ * suspend it. */
+#ifndef FLASH_ERASE_SLICE_US
+#define FLASH_ERASE_SLICE_US            2000
+#endif
+
+/* Longest page program, with margin */
+#ifndef FLASH_PROGRAM_TIMEOUT_US
+#define FLASH_PROGRAM_TIMEOUT_US        10000
+#endif
+
+/* FLEXSPI instance and AHB window of the flash holding the image slots */
+#ifdef AKNANO_BOARD_MODEL_RT1060
+#define UPDATE_EXAMPLE_FLEXSPI                        FLEXSPI
+#define UPDATE_EXAMPLE_FLEXSPI_AMBA_BASE              FlexSPI_AMBA_BASE
+#define FLASH_LIVE_IRQS                               ENET_IRQn
+#else
+#define UPDATE_EXAMPLE_FLEXSPI                        FLEXSPI1
+#define UPDATE_EXAMPLE_FLEXSPI_AMBA_BASE              FlexSPI1_AMBA_BASE
+#define FLASH_LIVE_IRQS                                                                               \
+    ENET_IRQn, ENET_1G_IRQn, ENET_1G_MAC0_Tx_Rx_1_IRQn, ENET_1G_MAC0_Tx_Rx_2_IRQn
+#endif
+
+/* Interrupts left enabled while the flash is programmed or erased
+ * (FLASH_LIVE_IRQS), all others being masked, at FLASH_IRQ_LIVE_PRIORITY.
+ * Their handlers, and everything they call, must be out of the flash: see the
+ * .ram_function section of the linker scripts. Interrupts and exceptions of
+ * FLASH_IRQ_MASK_PRIORITY and below, such as the FreeRTOS tick, are masked. */
+#ifndef FLASH_IRQ_LIVE_PRIORITY
+#define FLASH_IRQ_LIVE_PRIORITY         3
+#endif
+#ifndef FLASH_IRQ_MASK_PRIORITY
+#define FLASH_IRQ_MASK_PRIORITY         (FLASH_IRQ_LIVE_PRIORITY + 1)
+#endif
 /*${macro:end}*/
 
 /*******************************************************************************
  * Prototypes
  ******************************************************************************/
 /*${prototype:start}*/
+status_t flexspi_nor_wait_bus_busy(FLEXSPI_Type *base);
+status_t flexspi_nor_wait_busy(FLEXSPI_Type *base, uint32_t timeout_us);
 status_t sfw_flash_read(uint32_t dstAddr, void *buf, size_t len);
-status_t sfw_flash_read_ipc(uint32_t address, uint8_t *buffer, uint32_t length);
+void sfw_flash_written(uint32_t address, size_t length);
+status_t sfw_flash_read_ipc(uint32_t address, void *buffer, size_t length);
+status_t sfw_flash_read_ipc_start(uint32_t address, void *buffer, size_t length);
+status_t sfw_flash_read_ipc_wait(void);
+status_t flexspi_nor_flash_erase_sector(FLEXSPI_Type *base, uint32_t address);
+status_t flexspi_nor_flash_erase_block(FLEXSPI_Type *base, uint32_t address);
+status_t flexspi_nor_flash_program(FLEXSPI_Type *base, uint32_t address, const uint32_t *data, uint32_t length);
+void flexspi_nor_live_irqs_init(void);
 /*${prototype:end}*/
 
 #endif /* _FLEXSPI_FLASH_H_ */
@@ -13,30 +13,206 @@
 #else
 #include "app_rt1170.h"
 #endif
+#include "flexspi_flash_config.h"
+#include "flash_wear.h"
 
-#if (defined CACHE_MAINTAIN) && (CACHE_MAINTAIN == 1)
+/* The FlexSPI window is cacheable on both RT1060 and RT1170, whatever the
+ * CACHE_MAINTAIN setting of the demo: flash writes and eDMA buffers need cache
+ * maintenance wherever the core has a D-cache */
+#if defined(__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
 #include "fsl_cache.h"
 #endif
 
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
+
+#ifdef AKNANO_FLASH_EDMA
+#include "fsl_dmamux.h"
+#include "fsl_flexspi_edma.h"
+#endif
+
 /*******************************************************************************
  * Definitions
  ******************************************************************************/
+/* LUT sequence left unused by the mflash driver, loaded with the block erase
+ * command before each use as mflash_drv_init() rewrites the whole LUT */
+#define NOR_CMD_LUT_SEQ_IDX_ERASEBLOCK 14
+/* Same for the erase suspend and resume commands */
+#define NOR_CMD_LUT_SEQ_IDX_SUSPEND 15
+
+/* Status polling interval bounds of flexspi_nor_wait_busy() */
+#define FLEXSPI_NOR_POLL_MIN_US 10
+#define FLEXSPI_NOR_POLL_MAX_US 1000
+
+/* Status polling interval while programming pages: a page program takes a few
+ * hundred microseconds, the next one starts as soon as the flash is ready */
+#define FLEXSPI_NOR_PROGRAM_POLL_US 8
+
+/* Time for the flash to be ready again after a reset, aborting an erase included */
+#define FLASH_RESET_TIME_US 100
+
+/* Longest time for an erase to be suspended (tSUS), with margin */
+#define FLASH_SUSPEND_TIMEOUT_US 200
+
+/* Least erase time between a resume and the next suspend, so that an erase
+ * suspended over and over still completes */
+#define FLASH_RESUME_SUSPEND_US 100
+
+/* AHB reads are done by D-cache line sized bursts */
+#define FLEXSPI_AHB_BURST_SIZE 32
+
+/* Number and size of the recently written ranges read through the IP bus */
+#define SFW_FLASH_WRITTEN_RANGES   4
+#define SFW_FLASH_WRITTEN_MAX_SIZE SECTOR_SIZE
+
+/* Largest IP bus read started by sfw_flash_read_ipc_start(), bounding the eDMA wait */
+#define SFW_FLASH_IPC_MAX_SIZE SECTOR_SIZE
+
+/* Largest blocking IP bus read of sfw_flash_read(), within the 16 bits data
+ * size of an IP command; data goes straight into the destination */
+#define SFW_FLASH_READ_IPC_MAX_XFER 0x8000U
+
+/* Vector table entries: system exceptions, then the interrupts, within the
+ * 1K the startup vector table is given */
+#define FLEXSPI_NOR_VECTORS 256
+
+/* Remapped window of the AHB space (mcuboot image swap) */
+#ifdef AKNANO_BOARD_MODEL_RT1060
+#define FLEXSPI_REMAP_START  (IOMUXC_GPR->GPR30 & 0xFFFFF000U)
+#define FLEXSPI_REMAP_END    (IOMUXC_GPR->GPR31 & 0xFFFFF000U)
+#define FLEXSPI_REMAP_OFFSET (IOMUXC_GPR->GPR32 & 0xFFFFF000U)
+#else
+#define FLEXSPI_REMAP_START  (UPDATE_EXAMPLE_FLEXSPI->HADDRSTART & 0xFFFFF000U)
+#define FLEXSPI_REMAP_END    (UPDATE_EXAMPLE_FLEXSPI->HADDREND & 0xFFFFF000U)
+#define FLEXSPI_REMAP_OFFSET (UPDATE_EXAMPLE_FLEXSPI->HADDROFFSET & 0xFFFFF000U)
+#endif
+
+#ifdef AKNANO_FLASH_EDMA
+/* eDMA channel moving the IP RX FIFO content, and its request source */
+#ifndef FLEXSPI_EDMA_RX_CHANNEL
+#define FLEXSPI_EDMA_RX_CHANNEL 0
+#endif
+#define FLEXSPI_EDMA_RX_IRQ DMA0_DMA16_IRQn
+#ifdef AKNANO_BOARD_MODEL_RT1060
+#define FLEXSPI_EDMA_DMAMUX    DMAMUX
+#define FLEXSPI_EDMA_RX_SOURCE kDmaRequestMuxFlexSPIRx
+#else
+#define FLEXSPI_EDMA_DMAMUX    DMAMUX0
+#define FLEXSPI_EDMA_RX_SOURCE kDmaRequestMuxFlexSPI1Rx
+#endif
+
+/* Longest eDMA read of SFW_FLASH_IPC_MAX_SIZE bytes, with margin */
+#define FLEXSPI_EDMA_TIMEOUT_MS 100
+#endif
+
+typedef struct
+{
+    uint32_t start; /* flash offsets */
+    uint32_t end;
+} flash_range_t;
+
+typedef enum
+{
+    kFlexspiNorErase_Idle,
+    kFlexspiNorErase_Busy,
+    kFlexspiNorErase_Suspended,
+} flexspi_nor_erase_state_t;
+
+/* Interrupt masking state saved by flexspi_nor_mask_irqs() */
+typedef struct
+{
+    uint32_t basepri;
+    uint32_t enabled[ARRAY_SIZE(NVIC->ISER)]; /* interrupts disabled in the NVIC */
+} flexspi_nor_irq_mask_t;
 
 /*******************************************************************************
  * Prototypes
  ******************************************************************************/
+static void flexspi_nor_mask_irqs(flexspi_nor_irq_mask_t *mask);
+static void flexspi_nor_unmask_irqs(const flexspi_nor_irq_mask_t *mask);
 
 /*******************************************************************************
  * Variables
  *****************************************************************************/
+/* The AHB RX buffers may still hold the previous content of these ranges */
+static flash_range_t written_ranges[SFW_FLASH_WRITTEN_RANGES];
+static uint32_t written_next;
+
+/* Interrupts kept enabled while the flash is busy, once their vectors are
+ * fetched from RAM */
+static const IRQn_Type flexspi_nor_live_irqs[] = {FLASH_LIVE_IRQS};
+SDK_ALIGN(static uint32_t flexspi_nor_vectors[FLEXSPI_NOR_VECTORS], 1024);
+static bool flexspi_nor_vectors_ready;
+
+/* Erase in flight, suspended as long as someone holds it (readers, or the
+ * erasing task to let others run). Only changed with the interrupts masked by
+ * flexspi_nor_mask_irqs(), and the state itself with interrupts disabled. */
+static FLEXSPI_Type *erase_base;
+static volatile flexspi_nor_erase_state_t erase_state;
+static volatile uint32_t erase_holders;
+static uint32_t erase_resumed_at; /* cycle count */
+
+/* Serializes programs and erases between tasks, an erase being suspended
+ * while others run */
+static SemaphoreHandle_t flexspi_nor_mutex;
+static StaticSemaphore_t flexspi_nor_mutex_buffer;
+
+#ifdef AKNANO_FLASH_EDMA
+static edma_handle_t flexspi_rx_edma;
+static flexspi_edma_handle_t flexspi_edma;
+static bool flexspi_edma_ready;
+
+/* Read started by sfw_flash_read_ipc_start(): the task to notify, its
+ * completion status and the part left to the CPU */
+static TaskHandle_t flexspi_edma_task;
+static volatile status_t flexspi_edma_status;
+static void *flexspi_edma_buffer;
+static size_t flexspi_edma_length;
+static uint32_t flexspi_edma_tail_address;
+static uint8_t *flexspi_edma_tail_buffer;
+static size_t flexspi_edma_tail_length;
+#endif
 
 /*******************************************************************************
  * Code
  ******************************************************************************/
-status_t flexspi_nor_wait_bus_busy(FLEXSPI_Type *base)
+/* Cycle counter based delay: SDK_DelayAtLeastUs() runs from flash, which can
+ * not be read while it is busy */
+static void flexspi_nor_cycle_counter_init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static void flexspi_nor_delay_us(uint32_t us)
+{
+    uint32_t start  = DWT->CYCCNT;
+    uint32_t cycles = us * (SystemCoreClock / 1000000U);
+
+    while (DWT->CYCCNT - start < cycles)
+    {
+    }
+}
+
+/* Pause between two status polls. Other tasks get the CPU when nothing has to
+ * be fetched from the flash meanwhile: the application does not run from it,
+ * and interrupts are enabled. */
+static void flexspi_nor_poll_pause(uint32_t us)
+{
+#if !(defined(XIP_EXTERNAL_FLASH) && (XIP_EXTERNAL_FLASH == 1))
+    if (us >= portTICK_PERIOD_MS * 1000U && __get_PRIMASK() == 0U && __get_BASEPRI() == 0U &&
+        __get_IPSR() == 0U && xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+    {
+        vTaskDelay(pdMS_TO_TICKS(us / 1000U));
+        return;
+    }
+#endif
+    flexspi_nor_delay_us(us);
+}
+
+static status_t flexspi_nor_read_busy(FLEXSPI_Type *base, bool *isBusy)
 {
-    /* Wait status ready. */
-    bool isBusy;
     uint32_t readValue;
     status_t status;
     flexspi_transfer_t flashXfer;
@@ -49,53 +225,282 @@ status_t flexspi_nor_wait_bus_busy(FLEXSPI_Type *base)
     flashXfer.data          = &readValue;
     flashXfer.dataSize      = 1;
 
-    do
+    status = FLEXSPI_TransferBlocking(base, &flashXfer);
+    if (status != kStatus_Success)
+    {
+        return status;
+    }
+
+    if (FLASH_BUSY_STATUS_POL)
+    {
+        *isBusy = (readValue & (1U << FLASH_BUSY_STATUS_OFFSET)) != 0U;
+    }
+    else
     {
-        status = FLEXSPI_TransferBlocking(base, &flashXfer);
+        *isBusy = (readValue & (1U << FLASH_BUSY_STATUS_OFFSET)) == 0U;
+    }
+
+    return kStatus_Success;
+}
 
-        if (status != kStatus_Success)
+/* Reset the flash (66h, 99h), which aborts a program or erase that does not
+ * complete, so that it can be read again */
+static status_t flexspi_nor_reset(FLEXSPI_Type *base)
+{
+    static const uint32_t lut[2][4] = {
+        {FLEXSPI_LUT_SEQ(kFLEXSPI_Command_SDR, kFLEXSPI_1PAD, 0x66, kFLEXSPI_Command_STOP, kFLEXSPI_1PAD, 0)},
+        {FLEXSPI_LUT_SEQ(kFLEXSPI_Command_SDR, kFLEXSPI_1PAD, 0x99, kFLEXSPI_Command_STOP, kFLEXSPI_1PAD, 0)},
+    };
+    status_t status = kStatus_Success;
+    flexspi_transfer_t flashXfer;
+    uint32_t i;
+
+    for (i = 0; i < ARRAY_SIZE(lut) && status == kStatus_Success; i++)
+    {
+        FLEXSPI_UpdateLUT(base, NOR_CMD_LUT_SEQ_IDX_ERASEBLOCK * 4, lut[i], ARRAY_SIZE(lut[i]));
+
+        flashXfer.deviceAddress = 0;
+        flashXfer.port          = FLASH_PORT;
+        flashXfer.cmdType       = kFLEXSPI_Command;
+        flashXfer.SeqNumber     = 1;
+        flashXfer.seqIndex      = NOR_CMD_LUT_SEQ_IDX_ERASEBLOCK;
+        status                  = FLEXSPI_TransferBlocking(base, &flashXfer);
+    }
+
+    flexspi_nor_delay_us(FLASH_RESET_TIME_US);
+
+    return status;
+}
+
+/* Poll the status register until the flash is ready, at an interval growing
+ * from FLEXSPI_NOR_POLL_MIN_US up to max_interval, for at most timeout_us.
+ * Returns kStatus_Timeout if it is still busy. */
+static status_t flexspi_nor_poll_ready(FLEXSPI_Type *base, uint32_t timeout_us, uint32_t max_interval)
+{
+    uint32_t interval = MIN(FLEXSPI_NOR_POLL_MIN_US, max_interval);
+    uint32_t elapsed  = 0;
+    uint32_t start;
+    status_t status;
+    bool isBusy;
+
+    flexspi_nor_cycle_counter_init();
+
+    for (;;)
+    {
+        start  = DWT->CYCCNT;
+        status = flexspi_nor_read_busy(base, &isBusy);
+        if (status != kStatus_Success || !isBusy)
         {
             return status;
         }
-        if (FLASH_BUSY_STATUS_POL)
+
+        if (elapsed >= timeout_us)
         {
-            if (readValue & (1U << FLASH_BUSY_STATUS_OFFSET))
-            {
-                isBusy = true;
-            }
-            else
-            {
-                isBusy = false;
-            }
+            return kStatus_Timeout;
         }
-        else
+
+        flexspi_nor_poll_pause(interval);
+        elapsed += (DWT->CYCCNT - start) / (SystemCoreClock / 1000000U);
+        interval = MIN(interval * 2U, max_interval);
+    }
+}
+
+/* Same, the flash being reset on timeout */
+static status_t flexspi_nor_wait_ready(FLEXSPI_Type *base, uint32_t timeout_us, uint32_t max_interval)
+{
+    status_t status = flexspi_nor_poll_ready(base, timeout_us, max_interval);
+
+    if (status == kStatus_Timeout)
+    {
+        (void)flexspi_nor_reset(base);
+    }
+
+    return status;
+}
+
+/*
+ * Wait for the flash to complete a program or erase, for at most timeout_us.
+ * The status register is polled at an interval growing from
+ * FLEXSPI_NOR_POLL_MIN_US to FLEXSPI_NOR_POLL_MAX_US, so that short operations
+ * are noticed early and long ones do not keep the FlexSPI busy.
+ *
+ * On timeout the flash is reset and kStatus_Timeout returned.
+ */
+status_t flexspi_nor_wait_busy(FLEXSPI_Type *base, uint32_t timeout_us)
+{
+    return flexspi_nor_wait_ready(base, timeout_us, FLEXSPI_NOR_POLL_MAX_US);
+}
+
+status_t flexspi_nor_wait_bus_busy(FLEXSPI_Type *base)
+{
+    return flexspi_nor_wait_busy(base, FLASH_BUSY_TIMEOUT_US);
+}
+
+/* Send a single command byte through the NOR_CMD_LUT_SEQ_IDX_SUSPEND sequence */
+static status_t flexspi_nor_command(FLEXSPI_Type *base, uint8_t command)
+{
+    const uint32_t lut[4] = {
+        FLEXSPI_LUT_SEQ(kFLEXSPI_Command_SDR, kFLEXSPI_1PAD, command, kFLEXSPI_Command_STOP, kFLEXSPI_1PAD, 0),
+    };
+    flexspi_transfer_t flashXfer;
+
+    FLEXSPI_UpdateLUT(base, NOR_CMD_LUT_SEQ_IDX_SUSPEND * 4, lut, ARRAY_SIZE(lut));
+
+    flashXfer.deviceAddress = 0;
+    flashXfer.port          = FLASH_PORT;
+    flashXfer.cmdType       = kFLEXSPI_Command;
+    flashXfer.SeqNumber     = 1;
+    flashXfer.seqIndex      = NOR_CMD_LUT_SEQ_IDX_SUSPEND;
+
+    return FLEXSPI_TransferBlocking(base, &flashXfer);
+}
+
+/*
+ * Keep the flash readable: the erase in flight, if any, is suspended (75h)
+ * until the last holder calls flexspi_nor_erase_release(), and no erase starts
+ * meanwhile. To be called with the interrupts masked by
+ * flexspi_nor_mask_irqs(): the suspend may take FLASH_RESUME_SUSPEND_US plus
+ * FLASH_SUSPEND_TIMEOUT_US, during which the FLASH_LIVE_IRQS are still served.
+ *
+ * @retval kStatus_Success: the flash can be read
+ *         otherwise the erase could not be suspended
+ */
+static status_t flexspi_nor_erase_hold(void)
+{
+    uint32_t cycles_per_us = SystemCoreClock / 1000000U;
+    status_t status        = kStatus_Success;
+    uint32_t primask;
+    bool suspend;
+
+    primask = DisableGlobalIRQ();
+    suspend = erase_holders++ == 0U && erase_state == kFlexspiNorErase_Busy;
+    EnableGlobalIRQ(primask);
+
+    if (suspend)
+    {
+        /* let the erase make some progress since it was last resumed */
+        while (DWT->CYCCNT - erase_resumed_at < FLASH_RESUME_SUSPEND_US * cycles_per_us)
         {
-            if (readValue & (1U << FLASH_BUSY_STATUS_OFFSET))
-            {
-                isBusy = false;
-            }
-            else
-            {
-                isBusy = true;
-            }
         }
 
-    } while (isBusy);
+        status = flexspi_nor_command(erase_base, 0x75);
+        if (status == kStatus_Success)
+        {
+            status = flexspi_nor_poll_ready(erase_base, FLASH_SUSPEND_TIMEOUT_US, FLEXSPI_NOR_PROGRAM_POLL_US);
+        }
+
+        /* Do software reset to drop stale data from the AHB buffers. */
+        FLEXSPI_SoftwareReset(erase_base);
+
+        if (status == kStatus_Success)
+        {
+            primask     = DisableGlobalIRQ();
+            erase_state = kFlexspiNorErase_Suspended;
+            EnableGlobalIRQ(primask);
+        }
+    }
+
+    if (erase_state == kFlexspiNorErase_Busy)
+    {
+        return status == kStatus_Success ? kStatus_Busy : status;
+    }
+
+    return kStatus_Success;
+}
+
+/* Resume the erase (7Ah) once it is held no more. To be called with the
+ * interrupts masked by flexspi_nor_mask_irqs(), after each
+ * flexspi_nor_erase_hold(). */
+static void flexspi_nor_erase_release(void)
+{
+    uint32_t primask;
+    bool resume;
+
+    primask = DisableGlobalIRQ();
+    resume  = --erase_holders == 0U && erase_state == kFlexspiNorErase_Suspended;
+    EnableGlobalIRQ(primask);
+
+    if (resume)
+    {
+        (void)flexspi_nor_command(erase_base, 0x7A);
+
+        primask          = DisableGlobalIRQ();
+        erase_resumed_at = DWT->CYCCNT;
+        erase_state      = kFlexspiNorErase_Busy;
+        EnableGlobalIRQ(primask);
+    }
+}
+
+/* Hold the erase in flight while the caller reads the flash */
+static status_t flexspi_nor_read_begin(void)
+{
+    flexspi_nor_irq_mask_t mask;
+    status_t status;
+
+    flexspi_nor_mask_irqs(&mask);
+    status = flexspi_nor_erase_hold();
+    if (status != kStatus_Success)
+    {
+        flexspi_nor_erase_release();
+    }
+    flexspi_nor_unmask_irqs(&mask);
 
     return status;
 }
 
+static void flexspi_nor_read_end(void)
+{
+    flexspi_nor_irq_mask_t mask;
 
-// FIXME: set those in an appropriate header file
-// FLEXSPI
-#ifdef AKNANO_BOARD_MODEL_RT1060
-#define UPDATE_EXAMPLE_FLEXSPI                        FLEXSPI
-#define UPDATE_EXAMPLE_FLEXSPI_AMBA_BASE              FlexSPI_AMBA_BASE
-#else
-#define UPDATE_EXAMPLE_FLEXSPI                        FLEXSPI1
-#define UPDATE_EXAMPLE_FLEXSPI_AMBA_BASE              FlexSPI1_AMBA_BASE
-#endif
+    flexspi_nor_mask_irqs(&mask);
+    flexspi_nor_erase_release();
+    flexspi_nor_unmask_irqs(&mask);
+}
+
+/* Give the CPU to other tasks, or wait a bit when they can not run */
+static void flexspi_nor_yield(void)
+{
+    if (__get_PRIMASK() == 0U && __get_BASEPRI() == 0U && __get_IPSR() == 0U &&
+        xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+    {
+        vTaskDelay(1);
+        return;
+    }
+    flexspi_nor_delay_us(FLEXSPI_NOR_POLL_MAX_US);
+}
+
+/* Take the program and erase lock, when there are other tasks to exclude.
+ * Returns true if flexspi_nor_unlock() has to be called. */
+static bool flexspi_nor_lock(void)
+{
+    uint32_t primask;
+
+    if (__get_IPSR() != 0U || xTaskGetSchedulerState() != taskSCHEDULER_RUNNING)
+    {
+        return false;
+    }
 
+    primask = DisableGlobalIRQ();
+    if (flexspi_nor_mutex == NULL)
+    {
+        flexspi_nor_mutex = xSemaphoreCreateMutexStatic(&flexspi_nor_mutex_buffer);
+    }
+    EnableGlobalIRQ(primask);
+
+    (void)xSemaphoreTake(flexspi_nor_mutex, portMAX_DELAY);
+    return true;
+}
+
+static void flexspi_nor_unlock(bool locked)
+{
+    if (locked)
+    {
+        (void)xSemaphoreGive(flexspi_nor_mutex);
+    }
+}
+
+
+/* Read through the IP bus, an erase in flight being suspended meanwhile */
 status_t sfw_flash_read_ipc(uint32_t address, void *buffer, size_t length)
 {
     status_t status;
@@ -109,24 +514,764 @@ status_t sfw_flash_read_ipc(uint32_t address, void *buffer, size_t length)
     flashXfer.seqIndex      = NOR_CMD_LUT_SEQ_IDX_READ_FAST_QUAD;
     flashXfer.data          = (uint32_t *)(void *)buffer;
     flashXfer.dataSize      = length;
-    status                  = FLEXSPI_TransferBlocking(UPDATE_EXAMPLE_FLEXSPI, &flashXfer);
 
+    status = flexspi_nor_read_begin();
+    if (status != kStatus_Success)
+    {
+        return status;
+    }
+
+    status = FLEXSPI_TransferBlocking(UPDATE_EXAMPLE_FLEXSPI, &flashXfer);
+    if (status == kStatus_Success)
+    {
+        status = flexspi_nor_wait_bus_busy(UPDATE_EXAMPLE_FLEXSPI);
+    }
+
+    flexspi_nor_read_end();
+
+    return status;
+}
+
+#ifdef AKNANO_FLASH_EDMA
+static void flexspi_edma_callback(FLEXSPI_Type *base, flexspi_edma_handle_t *handle, status_t status, void *userData)
+{
+    BaseType_t woken = pdFALSE;
+
+    (void)base;
+    (void)handle;
+    (void)userData;
+
+    flexspi_edma_status = status;
+    vTaskNotifyGiveFromISR(flexspi_edma_task, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static void flexspi_edma_init(void)
+{
+    edma_config_t config;
+
+    DMAMUX_Init(FLEXSPI_EDMA_DMAMUX);
+    DMAMUX_SetSource(FLEXSPI_EDMA_DMAMUX, FLEXSPI_EDMA_RX_CHANNEL, FLEXSPI_EDMA_RX_SOURCE);
+    DMAMUX_EnableChannel(FLEXSPI_EDMA_DMAMUX, FLEXSPI_EDMA_RX_CHANNEL);
+
+    EDMA_GetDefaultConfig(&config);
+    EDMA_Init(DMA0, &config);
+    EDMA_CreateHandle(&flexspi_rx_edma, DMA0, FLEXSPI_EDMA_RX_CHANNEL);
+    /* the completion callback uses the FreeRTOS API */
+    NVIC_SetPriority(FLEXSPI_EDMA_RX_IRQ, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY);
+
+    FLEXSPI_TransferCreateHandleEDMA(UPDATE_EXAMPLE_FLEXSPI, &flexspi_edma, flexspi_edma_callback, NULL, NULL,
+                                     &flexspi_rx_edma);
+    flexspi_edma_ready = true;
+}
+
+/* Size of the IP RX FIFO watermark, moved by each eDMA minor loop */
+static uint32_t flexspi_rx_watermark(FLEXSPI_Type *base)
+{
+    return 8U * (((base->IPRXFCR & FLEXSPI_IPRXFCR_RXWMRK_MASK) >> FLEXSPI_IPRXFCR_RXWMRK_SHIFT) + 1U);
+}
+#endif
+
+/*
+ * Start reading at most SFW_FLASH_IPC_MAX_SIZE bytes through the IP bus, the
+ * FIFO being emptied by eDMA, and return without waiting. The read completes
+ * with sfw_flash_read_ipc_wait(), called from the same task, which can run
+ * something else meanwhile: the task sleeps until the eDMA interrupt.
+ *
+ * Whole FIFO watermarks are moved by eDMA, into a buffer aligned on D-cache
+ * lines; the unaligned remainder is read by sfw_flash_read_ipc_wait(). Without
+ * AKNANO_FLASH_EDMA, outside of tasks or before the scheduler starts, the
+ * whole read is done by sfw_flash_read_ipc_wait().
+ *
+ * An erase in flight is suspended until the read completes, and no other
+ * flash command must be issued meanwhile.
+ */
+status_t sfw_flash_read_ipc_start(uint32_t address, void *buffer, size_t length)
+{
+#ifdef AKNANO_FLASH_EDMA
+    flexspi_transfer_t flashXfer;
+    status_t status;
+    size_t dmaLength = 0;
+
+    if (length > SFW_FLASH_IPC_MAX_SIZE)
+    {
+        return kStatus_InvalidArgument;
+    }
+
+    if (__get_IPSR() == 0U && xTaskGetSchedulerState() == taskSCHEDULER_RUNNING &&
+        (uintptr_t)buffer % FLEXSPI_AHB_BURST_SIZE == 0U)
+    {
+        if (!flexspi_edma_ready)
+        {
+            flexspi_edma_init();
+        }
+        dmaLength = length - length % MAX(flexspi_rx_watermark(UPDATE_EXAMPLE_FLEXSPI), FLEXSPI_AHB_BURST_SIZE);
+    }
+
+    flexspi_edma_task         = NULL;
+    flexspi_edma_buffer       = buffer;
+    flexspi_edma_length       = dmaLength;
+    flexspi_edma_tail_address = address + dmaLength;
+    flexspi_edma_tail_buffer  = (uint8_t *)buffer + dmaLength;
+    flexspi_edma_tail_length  = length - dmaLength;
+
+    if (dmaLength == 0U)
+    {
+        return kStatus_Success;
+    }
+
+#if defined(__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+    /* no dirty line may be evicted over the data written by eDMA */
+    DCACHE_CleanInvalidateByRange((uint32_t)buffer, dmaLength);
+#endif
+
+    /* the erase in flight stays suspended until sfw_flash_read_ipc_wait() */
+    status = flexspi_nor_read_begin();
     if (status != kStatus_Success)
     {
         return status;
     }
 
-    status = flexspi_nor_wait_bus_busy(UPDATE_EXAMPLE_FLEXSPI);
+    flexspi_edma_task = xTaskGetCurrentTaskHandle();
+    (void)ulTaskNotifyTake(pdTRUE, 0);
+
+    flashXfer.deviceAddress = address & (~UPDATE_EXAMPLE_FLEXSPI_AMBA_BASE);
+    flashXfer.port          = kFLEXSPI_PortA1;
+    flashXfer.cmdType       = kFLEXSPI_Read;
+    flashXfer.SeqNumber     = 1;
+    flashXfer.seqIndex      = NOR_CMD_LUT_SEQ_IDX_READ_FAST_QUAD;
+    flashXfer.data          = (uint32_t *)buffer;
+    flashXfer.dataSize      = dmaLength;
+    status                  = FLEXSPI_TransferEDMA(UPDATE_EXAMPLE_FLEXSPI, &flexspi_edma, &flashXfer);
+    if (status != kStatus_Success)
+    {
+        flexspi_edma_task = NULL;
+        flexspi_nor_read_end();
+    }
 
     return status;
+#else
+    if (length > SFW_FLASH_IPC_MAX_SIZE)
+    {
+        return kStatus_InvalidArgument;
+    }
+
+    return sfw_flash_read_ipc(address, buffer, length);
+#endif
 }
 
+/*
+ * Wait for the read started by sfw_flash_read_ipc_start() to complete.
+ */
+status_t sfw_flash_read_ipc_wait(void)
+{
+#ifdef AKNANO_FLASH_EDMA
+    status_t status = kStatus_Success;
+
+    if (flexspi_edma_task != NULL)
+    {
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(FLEXSPI_EDMA_TIMEOUT_MS)) == 0U)
+        {
+            FLEXSPI_TransferAbortEDMA(UPDATE_EXAMPLE_FLEXSPI, &flexspi_edma);
+            FLEXSPI_SoftwareReset(UPDATE_EXAMPLE_FLEXSPI);
+            flexspi_edma_task = NULL;
+            flexspi_nor_read_end();
+            return kStatus_Timeout;
+        }
+
+        flexspi_edma_task = NULL;
+        status            = flexspi_edma_status;
+        flexspi_nor_read_end();
+#if defined(__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+        DCACHE_InvalidateByRange((uint32_t)flexspi_edma_buffer, flexspi_edma_length);
+#endif
+    }
+
+    if (status == kStatus_Success && flexspi_edma_tail_length > 0U)
+    {
+        status = sfw_flash_read_ipc(flexspi_edma_tail_address, flexspi_edma_tail_buffer, flexspi_edma_tail_length);
+        flexspi_edma_tail_length = 0;
+    }
+
+    return status;
+#else
+    return kStatus_Success;
+#endif
+}
+
+/*
+ * Record a programmed or erased range, so that sfw_flash_read() reads it
+ * through the IP bus until more recent writes push it out. Its D-cache lines
+ * are invalidated.
+ */
+void sfw_flash_written(uint32_t address, size_t length)
+{
+    flash_range_t *r;
+    uint32_t primask;
+    uint32_t i;
+
+    address &= ~UPDATE_EXAMPLE_FLEXSPI_AMBA_BASE;
+
+#if defined(__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+    DCACHE_InvalidateByRange(UPDATE_EXAMPLE_FLEXSPI_AMBA_BASE + address, length);
+#endif
+
+    primask = DisableGlobalIRQ();
+
+    /* pages are usually written in sequence, grow the range they extend */
+    for (i = 0; i < SFW_FLASH_WRITTEN_RANGES; i++)
+    {
+        r = &written_ranges[i];
+        if (r->end != 0 && address <= r->end && address + length >= r->start &&
+            MAX(r->end, address + length) - MIN(r->start, address) <= SFW_FLASH_WRITTEN_MAX_SIZE)
+        {
+            r->start = MIN(r->start, address);
+            r->end   = MAX(r->end, address + length);
+            break;
+        }
+    }
+
+    if (i == SFW_FLASH_WRITTEN_RANGES)
+    {
+        written_ranges[written_next].start = address;
+        written_ranges[written_next].end   = address + length;
+        written_next                       = (written_next + 1) % SFW_FLASH_WRITTEN_RANGES;
+    }
+
+    EnableGlobalIRQ(primask);
+}
+
+/* Clip a range against another one: returns true if address is within r,
+ * and shortens run to stay on the same side of r's bounds */
+static bool sfw_flash_clip(const flash_range_t *r, uint32_t address, size_t *run)
+{
+    if (r->end == 0)
+        return false;
+
+    if (address >= r->start && address < r->end)
+    {
+        *run = MIN(*run, r->end - address);
+        return true;
+    }
+
+    if (r->start > address)
+        *run = MIN(*run, r->start - address);
+
+    return false;
+}
+
+/* Find how many bytes from address can be read the same way, and whether
+ * they have to be read through the IP bus: recently written, or remapped
+ * to another part of the flash */
+static bool sfw_flash_needs_ipc(uint32_t address, size_t *run)
+{
+    flash_range_t remap;
+    bool ipc = false;
+    uint32_t primask;
+    uint32_t i;
+
+    if (FLEXSPI_REMAP_OFFSET != 0)
+    {
+        remap.start = FLEXSPI_REMAP_START & ~UPDATE_EXAMPLE_FLEXSPI_AMBA_BASE;
+        remap.end   = FLEXSPI_REMAP_END & ~UPDATE_EXAMPLE_FLEXSPI_AMBA_BASE;
+        ipc |= sfw_flash_clip(&remap, address, run);
+    }
+
+    primask = DisableGlobalIRQ();
+    for (i = 0; i < SFW_FLASH_WRITTEN_RANGES; i++)
+        ipc |= sfw_flash_clip(&written_ranges[i], address, run);
+    EnableGlobalIRQ(primask);
+
+    return ipc;
+}
+
+/* Copy from the AHB window by whole bursts, which the AHB RX buffer prefetch
+ * serves best; only the unaligned ends are copied byte by byte */
+static void sfw_flash_copy(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    uint32_t burst[FLEXSPI_AHB_BURST_SIZE / sizeof(uint32_t)];
+    const uint32_t *words;
+    uint32_t i;
+
+    while (len > 0 && (uintptr_t)src % FLEXSPI_AHB_BURST_SIZE != 0)
+    {
+        *dst++ = *src++;
+        len--;
+    }
+
+    for (; len >= FLEXSPI_AHB_BURST_SIZE; len -= FLEXSPI_AHB_BURST_SIZE)
+    {
+        words = (const uint32_t *)(const void *)src;
+        for (i = 0; i < ARRAY_SIZE(burst); i++)
+        {
+            burst[i] = words[i];
+        }
+        memcpy(dst, burst, FLEXSPI_AHB_BURST_SIZE);
+        src += FLEXSPI_AHB_BURST_SIZE;
+        dst += FLEXSPI_AHB_BURST_SIZE;
+    }
+
+    while (len > 0)
+    {
+        *dst++ = *src++;
+        len--;
+    }
+}
+
+/*
+ * Read from flash through the AHB window, coherently with the programs and
+ * erases recorded with sfw_flash_written(). The D-cache lines of the range
+ * are invalidated first; recently written and remapped ranges are read
+ * through the IP bus instead. Any alignment is supported.
+ *
+ * An erase in flight is suspended until the read completes.
+ */
 status_t sfw_flash_read(uint32_t dstAddr, void *buf, size_t len)
 {
-	uint32_t addr = dstAddr | UPDATE_EXAMPLE_FLEXSPI_AMBA_BASE;
+    uint32_t address = dstAddr & ~UPDATE_EXAMPLE_FLEXSPI_AMBA_BASE;
+    uint8_t *dst     = (uint8_t *)buf;
+    status_t status;
+    size_t run;
+
+    status = flexspi_nor_read_begin();
+    if (status != kStatus_Success)
+    {
+        return status;
+    }
+
+    while (len > 0)
+    {
+        run = len;
+        if (sfw_flash_needs_ipc(address, &run))
+        {
+            run    = MIN(run, SFW_FLASH_READ_IPC_MAX_XFER);
+            status = sfw_flash_read_ipc(UPDATE_EXAMPLE_FLEXSPI_AMBA_BASE + address, dst, run);
+            if (status != kStatus_Success)
+            {
+                break;
+            }
+        }
+        else
+        {
+#if defined(__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+            DCACHE_InvalidateByRange(UPDATE_EXAMPLE_FLEXSPI_AMBA_BASE + address, run);
+#endif
+            sfw_flash_copy(dst, (const uint8_t *)(UPDATE_EXAMPLE_FLEXSPI_AMBA_BASE + address), run);
+        }
+
+        address += run;
+        dst += run;
+        len -= run;
+    }
+
+    flexspi_nor_read_end();
+
+    return status;
+}
+
+/*
+ * Move the vector table to RAM and raise the FLASH_LIVE_IRQS above
+ * FLASH_IRQ_MASK_PRIORITY, so that they are served while the flash is
+ * programmed or erased. To be called once their drivers have set them up.
+ */
+void flexspi_nor_live_irqs_init(void)
+{
+    uint32_t primask;
+    uint32_t i;
+
+    primask = DisableGlobalIRQ();
+
+    if (!flexspi_nor_vectors_ready)
+    {
+        memcpy(flexspi_nor_vectors, (const void *)SCB->VTOR, sizeof(flexspi_nor_vectors));
+#if defined(__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+        DCACHE_CleanByRange((uint32_t)flexspi_nor_vectors, sizeof(flexspi_nor_vectors));
+#endif
+        SCB->VTOR = (uint32_t)flexspi_nor_vectors;
+        __DSB();
+        __ISB();
+        flexspi_nor_vectors_ready = true;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(flexspi_nor_live_irqs); i++)
+    {
+        NVIC_SetPriority(flexspi_nor_live_irqs[i], FLASH_IRQ_LIVE_PRIORITY);
+    }
+
+    EnableGlobalIRQ(primask);
+}
+
+/* Mask the interrupts which could run code from the flash while it is busy:
+ * all the exceptions of FLASH_IRQ_MASK_PRIORITY and below, and all the
+ * interrupts but the FLASH_LIVE_IRQS, whatever their priority. */
+static void flexspi_nor_mask_irqs(flexspi_nor_irq_mask_t *mask)
+{
+    uint32_t live[ARRAY_SIZE(mask->enabled)] = {0};
+    uint32_t primask;
+    uint32_t irq;
+    uint32_t i;
+
+    /* Vectors are fetched from the flash until flexspi_nor_live_irqs_init() */
+    for (i = 0; flexspi_nor_vectors_ready && i < ARRAY_SIZE(flexspi_nor_live_irqs); i++)
+    {
+        irq = (uint32_t)flexspi_nor_live_irqs[i];
+        live[irq >> 5] |= 1UL << (irq & 0x1FUL);
+    }
+
+    primask       = DisableGlobalIRQ();
+    mask->basepri = __get_BASEPRI();
+    __set_BASEPRI_MAX(FLASH_IRQ_MASK_PRIORITY << (8U - __NVIC_PRIO_BITS));
+    for (i = 0; i < ARRAY_SIZE(mask->enabled); i++)
+    {
+        mask->enabled[i] = NVIC->ISER[i] & ~live[i];
+        NVIC->ICER[i]    = mask->enabled[i];
+    }
+    __DSB();
+    __ISB();
+    EnableGlobalIRQ(primask);
+}
+
+static void flexspi_nor_unmask_irqs(const flexspi_nor_irq_mask_t *mask)
+{
+    uint32_t i;
+
+    for (i = 0; i < ARRAY_SIZE(mask->enabled); i++)
+    {
+        NVIC->ISER[i] = mask->enabled[i];
+    }
+    __set_BASEPRI(mask->basepri);
+    __ISB();
+}
+
+static status_t flexspi_nor_write_enable(FLEXSPI_Type *base, uint32_t baseAddr)
+{
+    flexspi_transfer_t flashXfer;
+
+    flashXfer.deviceAddress = baseAddr;
+    flashXfer.port          = FLASH_PORT;
+    flashXfer.cmdType       = kFLEXSPI_Command;
+    flashXfer.SeqNumber     = 1;
+    flashXfer.seqIndex      = NOR_CMD_LUT_SEQ_IDX_WRITEENABLE;
+
+    return FLEXSPI_TransferBlocking(base, &flashXfer);
+}
+
+#if defined(XIP_EXTERNAL_FLASH) && (XIP_EXTERNAL_FLASH == 1)
+/* Suspend the erase and unmask the interrupts, so that those pending and the
+ * tasks of higher priority run from the flash, then take the CPU back. With
+ * sleep set, tasks of lower priority get it too, for a tick. */
+static void flexspi_nor_erase_window(flexspi_nor_irq_mask_t *mask, bool sleep)
+{
+    status_t status;
+
+    status = flexspi_nor_erase_hold();
+    if (status == kStatus_Success)
+    {
+        flexspi_nor_unmask_irqs(mask);
+        if (sleep)
+        {
+            flexspi_nor_yield();
+        }
+        else if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING && __get_IPSR() == 0U)
+        {
+            taskYIELD();
+        }
+        flexspi_nor_mask_irqs(mask);
+    }
+
+    flexspi_nor_erase_release();
+}
+#endif
+
+/*
+ * Wait for the erase in flight to complete, for at most FLASH_BUSY_TIMEOUT_US
+ * of erase time, polling its status at a growing interval. Flash reads
+ * meanwhile suspend it (flexspi_nor_erase_hold()).
+ *
+ * When the application runs from the flash, nothing else can read it, as
+ * interrupts are masked: every FLASH_ERASE_SLICE_US the erase is suspended
+ * and they are unmasked for a while instead.
+ */
+static status_t flexspi_nor_erase_wait(FLEXSPI_Type *base, flexspi_nor_irq_mask_t *mask)
+{
+    uint32_t interval = FLEXSPI_NOR_POLL_MIN_US;
+    uint32_t elapsed  = 0; /* erase time, suspensions excluded */
+    uint32_t slice    = 0;
+    uint32_t primask;
+    uint32_t start;
+    uint32_t spent;
+    status_t status;
+    bool suspended;
+    bool isBusy;
+
+    (void)mask;
+
+    for (;;)
+    {
+        start = DWT->CYCCNT;
+
+        primask   = DisableGlobalIRQ();
+        suspended = erase_state == kFlexspiNorErase_Suspended;
+        isBusy    = true;
+        status    = suspended ? kStatus_Success : flexspi_nor_read_busy(base, &isBusy);
+        EnableGlobalIRQ(primask);
+
+        if (status != kStatus_Success || !isBusy)
+        {
+            return status;
+        }
+
+        if (elapsed >= FLASH_BUSY_TIMEOUT_US)
+        {
+            (void)flexspi_nor_reset(base);
+            return kStatus_Timeout;
+        }
+
+#if defined(XIP_EXTERNAL_FLASH) && (XIP_EXTERNAL_FLASH == 1)
+        /* still held by a reader of lower priority, let it complete */
+        if (suspended)
+        {
+            flexspi_nor_erase_window(mask, true);
+            continue;
+        }
+
+        if (FLASH_ERASE_SLICE_US != 0U && slice >= FLASH_ERASE_SLICE_US)
+        {
+            flexspi_nor_erase_window(mask, false);
+            slice    = 0;
+            interval = FLEXSPI_NOR_POLL_MIN_US;
+            continue;
+        }
+#endif
+
+        flexspi_nor_poll_pause(interval);
+        spent = (DWT->CYCCNT - start) / (SystemCoreClock / 1000000U);
+        if (!suspended)
+        {
+            elapsed += spent;
+            slice += spent;
+        }
+        interval = MIN(interval * 2U, FLEXSPI_NOR_POLL_MAX_US);
+    }
+}
+
+/*
+ * Let the reads in progress (sfw_flash_read_ipc() and eDMA reads) complete,
+ * with the irqs of mask masked. Return with interrupts disabled, so that no
+ * read starts before the flash command is issued; the PRIMASK to restore is
+ * returned.
+ */
+static uint32_t flexspi_nor_wait_readers(flexspi_nor_irq_mask_t *mask)
+{
+    uint32_t primask;
+
+    primask = DisableGlobalIRQ();
+    while (erase_holders != 0U)
+    {
+        EnableGlobalIRQ(primask);
+        flexspi_nor_unmask_irqs(mask);
+        flexspi_nor_yield();
+        flexspi_nor_mask_irqs(mask);
+        primask = DisableGlobalIRQ();
+    }
+
+    return primask;
+}
+
+/*
+ * Erase with the seqIndex LUT sequence the size bytes at the given flash
+ * offset. When the application runs from the flash (XIP_EXTERNAL_FLASH),
+ * interrupts are masked while the erase runs, as code can not be fetched from
+ * it meanwhile: this function has to run from RAM, and so do the handlers of
+ * the FLASH_LIVE_IRQS, left enabled. Otherwise other tasks run while the
+ * erase is waited for.
+ *
+ * Either way, the erase is suspended when the flash is read through
+ * sfw_flash_read(), sfw_flash_read_ipc() or sfw_flash_read_ipc_start(), and
+ * other programs and erases wait for it to complete.
+ */
+static status_t flexspi_nor_flash_erase(FLEXSPI_Type *base, uint32_t address, uint32_t seqIndex, uint32_t size)
+{
+    static const uint32_t erase_block_lut[4] = {
+        FLEXSPI_LUT_SEQ(kFLEXSPI_Command_SDR, kFLEXSPI_1PAD, 0xD8, kFLEXSPI_Command_RADDR_SDR, kFLEXSPI_1PAD, 0x18),
+    };
+    status_t status;
+    flexspi_transfer_t flashXfer;
+    flexspi_nor_irq_mask_t mask;
+    uint32_t primask;
+    uint32_t start;
+    bool locked;
+
+    address &= ~UPDATE_EXAMPLE_FLEXSPI_AMBA_BASE;
+
+    flexspi_nor_cycle_counter_init();
+    locked = flexspi_nor_lock();
+    flexspi_nor_mask_irqs(&mask);
+
+    primask = flexspi_nor_wait_readers(&mask);
+
+    if (seqIndex == NOR_CMD_LUT_SEQ_IDX_ERASEBLOCK)
+    {
+        FLEXSPI_UpdateLUT(base, NOR_CMD_LUT_SEQ_IDX_ERASEBLOCK * 4, erase_block_lut, ARRAY_SIZE(erase_block_lut));
+    }
+
+    start  = DWT->CYCCNT;
+    status = flexspi_nor_write_enable(base, address);
+    if (status == kStatus_Success)
+    {
+        flashXfer.deviceAddress = address;
+        flashXfer.port          = FLASH_PORT;
+        flashXfer.cmdType       = kFLEXSPI_Command;
+        flashXfer.SeqNumber     = 1;
+        flashXfer.seqIndex      = seqIndex;
+        status                  = FLEXSPI_TransferBlocking(base, &flashXfer);
+    }
+
+    if (status == kStatus_Success)
+    {
+        erase_base       = base;
+        erase_resumed_at = DWT->CYCCNT;
+        erase_state      = kFlexspiNorErase_Busy;
+    }
+    EnableGlobalIRQ(primask);
+
+#if !(defined(XIP_EXTERNAL_FLASH) && (XIP_EXTERNAL_FLASH == 1))
+    flexspi_nor_unmask_irqs(&mask);
+#endif
+
+    if (status == kStatus_Success)
+    {
+        status = flexspi_nor_erase_wait(base, &mask);
+    }
+
+    primask     = DisableGlobalIRQ();
+    erase_state = kFlexspiNorErase_Idle;
+    /* Do software reset to drop stale data from the AHB buffers. */
+    FLEXSPI_SoftwareReset(base);
+    EnableGlobalIRQ(primask);
+
+#if defined(XIP_EXTERNAL_FLASH) && (XIP_EXTERNAL_FLASH == 1)
+    flexspi_nor_unmask_irqs(&mask);
+#endif
+    flexspi_nor_unlock(locked);
+
+#if defined(__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+    DCACHE_InvalidateByRange(UPDATE_EXAMPLE_FLEXSPI_AMBA_BASE + address, size);
+#endif
+
+    if (status == kStatus_Success)
+    {
+        flash_wear_count(kFlashWear_Erase, address, size, (DWT->CYCCNT - start) / (SystemCoreClock / 1000000U));
+    }
+
+    return status;
+}
+
+/*
+ * Erase the SECTOR_SIZE sector at the given flash offset, like
+ * mflash_drv_sector_erase() but with only the non-critical interrupts masked.
+ */
+status_t flexspi_nor_flash_erase_sector(FLEXSPI_Type *base, uint32_t address)
+{
+    if (address % SECTOR_SIZE != 0)
+    {
+        return kStatus_InvalidArgument;
+    }
+
+    return flexspi_nor_flash_erase(base, address, NOR_CMD_LUT_SEQ_IDX_ERASESECTOR, SECTOR_SIZE);
+}
 
-//	DCACHE_CleanInvalidateByRange(addr, len);
-	memcpy(buf, (void *)addr, len);
+/*
+ * Erase the FLASH_BLOCK_SIZE block at the given flash offset.
+ */
+status_t flexspi_nor_flash_erase_block(FLEXSPI_Type *base, uint32_t address)
+{
+    if (FLASH_BLOCK_SIZE == 0 || address % FLASH_BLOCK_SIZE != 0)
+    {
+        return kStatus_InvalidArgument;
+    }
 
-	return 0;
+    return flexspi_nor_flash_erase(base, address, NOR_CMD_LUT_SEQ_IDX_ERASEBLOCK, FLASH_BLOCK_SIZE);
+}
+
+/*
+ * Program length bytes from address, both multiples of FLASH_PAGE_SIZE, with
+ * quad page programs issued back to back: each page is sent as soon as the
+ * previous one completes, the status being polled every
+ * FLEXSPI_NOR_PROGRAM_POLL_US. The FlexSPI reset and cache maintenance the
+ * mflash driver does after each page are done once for all of them, by this
+ * function and sfw_flash_written().
+ *
+ * Interrupts but the FLASH_LIVE_IRQS are masked while each page is
+ * programmed, as code can not be fetched from the flash meanwhile: this
+ * function has to run from RAM. The pages must be erased.
+ */
+status_t flexspi_nor_flash_program(FLEXSPI_Type *base, uint32_t address, const uint32_t *data, uint32_t length)
+{
+    status_t status = kStatus_Success;
+    flexspi_transfer_t flashXfer;
+    flexspi_nor_irq_mask_t mask;
+    uint32_t primask;
+    uint32_t offset;
+    uint32_t start;
+    bool locked;
+
+    if (address % FLASH_PAGE_SIZE != 0U || length % FLASH_PAGE_SIZE != 0U)
+    {
+        return kStatus_InvalidArgument;
+    }
+
+    address &= ~UPDATE_EXAMPLE_FLEXSPI_AMBA_BASE;
+
+    /* not while an erase is suspended, nor a read is in progress */
+    flexspi_nor_cycle_counter_init();
+    locked = flexspi_nor_lock();
+    start  = DWT->CYCCNT;
+
+    for (offset = 0; offset < length && status == kStatus_Success; offset += FLASH_PAGE_SIZE)
+    {
+        flexspi_nor_mask_irqs(&mask);
+        primask = flexspi_nor_wait_readers(&mask);
+
+        status = flexspi_nor_write_enable(base, address + offset);
+        if (status == kStatus_Success)
+        {
+            flashXfer.deviceAddress = address + offset;
+            flashXfer.port          = FLASH_PORT;
+            flashXfer.cmdType       = kFLEXSPI_Write;
+            flashXfer.SeqNumber     = 1;
+            flashXfer.seqIndex      = NOR_CMD_LUT_SEQ_IDX_PAGEPROGRAM_QUAD;
+            flashXfer.data          = (uint32_t *)(uintptr_t)&data[offset / sizeof(uint32_t)];
+            flashXfer.dataSize      = FLASH_PAGE_SIZE;
+            status                  = FLEXSPI_TransferBlocking(base, &flashXfer);
+        }
+        EnableGlobalIRQ(primask);
+
+        if (status == kStatus_Success)
+        {
+            status = flexspi_nor_wait_ready(base, FLASH_PROGRAM_TIMEOUT_US, FLEXSPI_NOR_PROGRAM_POLL_US);
+        }
+
+        flexspi_nor_unmask_irqs(&mask);
+    }
+
+    flexspi_nor_mask_irqs(&mask);
+    /* Do software reset to drop stale data from the AHB buffers. */
+    FLEXSPI_SoftwareReset(base);
+    flexspi_nor_unmask_irqs(&mask);
+
+    flexspi_nor_unlock(locked);
+
+#if defined(__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+    DCACHE_InvalidateByRange(UPDATE_EXAMPLE_FLEXSPI_AMBA_BASE + address, length);
+#endif
+
+    /* pages programmed before a failure wore the flash too, the latency is per page */
+    if (offset != 0U)
+    {
+        flash_wear_count(kFlashWear_Program, address, offset,
+                         (DWT->CYCCNT - start) / (SystemCoreClock / 1000000U) / (offset / FLASH_PAGE_SIZE));
+    }
+
+    return status;
 }
@@ -0,0 +1,47 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*
+ * Host runner for flash_benchmark.c. The emulated flash is backed by the
+ * file given as first argument, or by MFLASH_HOST_FILE, or kept in memory.
+ * A 1 MB image is placed in the running slot when it holds none.
+ */
+
+#include <stdio.h>
+
+#include "flash_benchmark.h"
+#include "mcuboot_app_support.h"
+#include "mflash_drv.h"
+#include "partition_table.h"
+#include "test_image_host.h"
+
+int main(int argc, char **argv)
+{
+    const test_image_t img = {.body_size = 0x100000, .build_num = 1};
+    const partition_entry_t *slot;
+    uint32_t magic;
+    status_t status;
+
+    if (argc > 1 && mflash_host_open(argv[1], MFLASH_HOST_DEFAULT_SIZE) != kStatus_Success)
+    {
+        fprintf(stderr, "Unable to open flash image %s\n", argv[1]);
+        return 1;
+    }
+
+    if (mflash_drv_init() != kStatus_Success)
+        return 1;
+
+    slot = partition_slot(0, get_active_image());
+    memcpy(&magic, mflash_host_memory() + slot->offset, sizeof(magic));
+    if (magic != IMAGE_MAGIC)
+        test_image_write(slot->offset, &img);
+
+    status = flash_bench_run();
+    mflash_host_close();
+
+    return status == kStatus_Success ? 0 : 1;
+}
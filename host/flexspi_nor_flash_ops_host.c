@@ -0,0 +1,111 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*
+ * Host implementation of the direct FlexSPI accessors of
+ * flexspi_nor_flash_ops.c, on top of the emulated flash of mflash_drv_host.c.
+ */
+
+#include "flexspi_flash_config.h"
+#include "flash_wear.h"
+#include "mflash_drv.h"
+
+status_t flexspi_nor_wait_bus_busy(FLEXSPI_Type *base)
+{
+    (void)base;
+    return kStatus_Success;
+}
+
+status_t flexspi_nor_wait_busy(FLEXSPI_Type *base, uint32_t timeout_us)
+{
+    (void)base;
+    (void)timeout_us;
+    return kStatus_Success;
+}
+
+static status_t sfw_flash_host_copy(uint32_t address, void *buffer, size_t length)
+{
+    if (mflash_drv_init() != kStatus_Success)
+        return kStatus_Fail;
+
+    address &= ~UPDATE_EXAMPLE_FLEXSPI_AMBA_BASE;
+    if (address > mflash_host_size() || length > mflash_host_size() - address)
+        return kStatus_OutOfRange;
+
+    memcpy(buffer, mflash_host_memory() + address, length);
+    return kStatus_Success;
+}
+
+status_t sfw_flash_read_ipc(uint32_t address, void *buffer, size_t length)
+{
+    return sfw_flash_host_copy(address, buffer, length);
+}
+
+/* reads complete at once, there is no eDMA to wait for */
+status_t sfw_flash_read_ipc_start(uint32_t address, void *buffer, size_t length)
+{
+    return sfw_flash_host_copy(address, buffer, length);
+}
+
+status_t sfw_flash_read_ipc_wait(void)
+{
+    return kStatus_Success;
+}
+
+status_t sfw_flash_read(uint32_t dstAddr, void *buf, size_t len)
+{
+    return sfw_flash_host_copy(dstAddr, buf, len);
+}
+
+/* the emulated flash has no cache nor AHB buffers to keep coherent */
+void sfw_flash_written(uint32_t address, size_t length)
+{
+    (void)address;
+    (void)length;
+}
+
+status_t flexspi_nor_flash_erase_sector(FLEXSPI_Type *base, uint32_t address)
+{
+    (void)base;
+    if (address % MFLASH_SECTOR_SIZE != 0)
+        return kStatus_InvalidArgument;
+
+    flash_wear_count(kFlashWear_Erase, address, MFLASH_SECTOR_SIZE, 0);
+    return mflash_drv_sector_erase(address);
+}
+
+status_t flexspi_nor_flash_erase_block(FLEXSPI_Type *base, uint32_t address)
+{
+    uint32_t off;
+    status_t status = kStatus_Success;
+
+    (void)base;
+    if (FLASH_BLOCK_SIZE == 0 || address % FLASH_BLOCK_SIZE != 0)
+        return kStatus_InvalidArgument;
+
+    flash_wear_count(kFlashWear_Erase, address, FLASH_BLOCK_SIZE, 0);
+    for (off = 0; off < FLASH_BLOCK_SIZE && status == kStatus_Success; off += MFLASH_SECTOR_SIZE)
+        status = mflash_drv_sector_erase(address + off);
+
+    return status;
+}
+
+status_t flexspi_nor_flash_program(FLEXSPI_Type *base, uint32_t address, const uint32_t *data, uint32_t length)
+{
+    uint32_t off;
+    status_t status = kStatus_Success;
+
+    (void)base;
+    if (address % MFLASH_PAGE_SIZE != 0 || length % MFLASH_PAGE_SIZE != 0)
+        return kStatus_InvalidArgument;
+
+    flash_wear_count(kFlashWear_Program, address, length, 0);
+    for (off = 0; off < length && status == kStatus_Success; off += MFLASH_PAGE_SIZE)
+        status = mflash_drv_page_program(address + off, (uint32_t *)(uintptr_t)&data[off / sizeof(uint32_t)]);
+
+    return status;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*
+ * Minimal host replacement for the MCUXpresso SDK fsl_common.h, providing
+ * only what the flash and bootloader support code needs.
+ */
+
+#ifndef _FSL_COMMON_H_
+#define _FSL_COMMON_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef int32_t status_t;
+
+#define MAKE_STATUS(group, code) ((((group)*100) + (code)))
+
+enum
+{
+    kStatusGroup_Generic = 0,
+};
+
+enum
+{
+    kStatus_Success              = MAKE_STATUS(kStatusGroup_Generic, 0),
+    kStatus_Fail                 = MAKE_STATUS(kStatusGroup_Generic, 1),
+    kStatus_ReadOnly             = MAKE_STATUS(kStatusGroup_Generic, 2),
+    kStatus_OutOfRange           = MAKE_STATUS(kStatusGroup_Generic, 3),
+    kStatus_InvalidArgument      = MAKE_STATUS(kStatusGroup_Generic, 4),
+    kStatus_Timeout              = MAKE_STATUS(kStatusGroup_Generic, 5),
+    kStatus_NoTransferInProgress = MAKE_STATUS(kStatusGroup_Generic, 6),
+    kStatus_Busy                 = MAKE_STATUS(kStatusGroup_Generic, 7),
+    kStatus_NoData               = MAKE_STATUS(kStatusGroup_Generic, 8),
+};
+
+#ifndef MIN
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+
+#ifndef MAX
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+#endif
+
+/* single threaded, there is nothing to mask */
+static inline uint32_t DisableGlobalIRQ(void)
+{
+    return 0;
+}
+
+static inline void EnableGlobalIRQ(uint32_t primask)
+{
+    (void)primask;
+}
+
+#endif /* _FSL_COMMON_H_ */
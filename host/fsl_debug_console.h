@@ -0,0 +1,15 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _FSL_DEBUGCONSOLE_H_
+#define _FSL_DEBUGCONSOLE_H_
+
+#include <stdio.h>
+
+#define PRINTF printf
+
+#endif /* _FSL_DEBUGCONSOLE_H_ */
@@ -0,0 +1,26 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*
+ * Minimal host replacement for the MCUXpresso SDK fsl_flexspi.h. The FlexSPI
+ * instances are opaque and the AHB window starts at offset 0 of the
+ * emulated flash.
+ */
+
+#ifndef _FSL_FLEXSPI_H_
+#define _FSL_FLEXSPI_H_
+
+#include "fsl_common.h"
+
+typedef struct _FLEXSPI_Type FLEXSPI_Type;
+
+#define FLEXSPI            ((FLEXSPI_Type *)0)
+#define FLEXSPI1           ((FLEXSPI_Type *)0)
+#define FlexSPI_AMBA_BASE  0U
+#define FlexSPI1_AMBA_BASE 0U
+
+#endif /* _FSL_FLEXSPI_H_ */
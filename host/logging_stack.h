@@ -0,0 +1,63 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*
+ * Host replacement for the FreeRTOS logging stack, printing to stderr.
+ * Like the original, it is meant to be included once per source file, after
+ * LIBRARY_LOG_NAME and LIBRARY_LOG_LEVEL are defined.
+ */
+
+#include <stdio.h>
+
+#include "logging_levels.h"
+
+#ifndef LIBRARY_LOG_NAME
+#define LIBRARY_LOG_NAME "host"
+#endif
+
+#ifndef LIBRARY_LOG_LEVEL
+#define LIBRARY_LOG_LEVEL LOG_ERROR
+#endif
+
+#define HOST_LOG_PRINT(level, message)                        \
+    do                                                        \
+    {                                                         \
+        fprintf(stderr, "[%s] [%s] ", level, LIBRARY_LOG_NAME); \
+        fprintf message;                                      \
+        fprintf(stderr, "\n");                                \
+    } while (0)
+
+#define HOST_LOG_ARGS(...) (stderr, __VA_ARGS__)
+
+#undef LogError
+#undef LogWarn
+#undef LogInfo
+#undef LogDebug
+
+#if LIBRARY_LOG_LEVEL >= LOG_ERROR
+#define LogError(message) HOST_LOG_PRINT("ERROR", HOST_LOG_ARGS message)
+#else
+#define LogError(message)
+#endif
+
+#if LIBRARY_LOG_LEVEL >= LOG_WARN
+#define LogWarn(message) HOST_LOG_PRINT("WARN", HOST_LOG_ARGS message)
+#else
+#define LogWarn(message)
+#endif
+
+#if LIBRARY_LOG_LEVEL >= LOG_INFO
+#define LogInfo(message) HOST_LOG_PRINT("INFO", HOST_LOG_ARGS message)
+#else
+#define LogInfo(message)
+#endif
+
+#if LIBRARY_LOG_LEVEL >= LOG_DEBUG
+#define LogDebug(message) HOST_LOG_PRINT("DEBUG", HOST_LOG_ARGS message)
+#else
+#define LogDebug(message)
+#endif
@@ -0,0 +1,55 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*
+ * Host (Linux) mflash backend: the NOR flash is kept in a RAM buffer or in an
+ * mmap'd file, with the same API as the MCUXpresso SDK mflash driver.
+ * NOR rules are enforced: erase sets whole 4 KB sectors to 0xFF, program
+ * works on whole 256 bytes pages and may only clear bits.
+ */
+
+#ifndef __MFLASH_DRV_H__
+#define __MFLASH_DRV_H__
+
+#include "fsl_common.h"
+
+#define MFLASH_PAGE_SIZE   256
+#define MFLASH_SECTOR_SIZE 0x1000
+
+/* Default emulated flash size, covering bootloader, both slots and storage */
+#define MFLASH_HOST_DEFAULT_SIZE 0x800000
+
+/* Emulated FlexSPI remap offset register, see get_active_image() */
+extern volatile uint32_t mflash_host_remap_offset;
+#define FLASH_REMAP_OFFSET_REG ((uintptr_t)&mflash_host_remap_offset)
+
+typedef struct
+{
+    uint32_t reads;
+    uint32_t read_bytes;
+    uint32_t page_programs;
+    uint32_t sector_erases;
+    uint32_t violations; /* program attempts that tried to set bits back to 1 */
+} mflash_host_stats_t;
+
+/* mflash driver API */
+int32_t mflash_drv_init(void);
+int32_t mflash_drv_sector_erase(uint32_t sector_addr);
+int32_t mflash_drv_page_program(uint32_t page_addr, uint32_t *data);
+int32_t mflash_drv_read(uint32_t addr, uint32_t *buffer, uint32_t len);
+void *mflash_drv_phys2log(uint32_t addr, uint32_t len);
+uint32_t mflash_drv_log2phys(void *ptr, uint32_t len);
+
+/* Emulator control */
+status_t mflash_host_open(const char *path, uint32_t size);
+void mflash_host_close(void);
+uint8_t *mflash_host_memory(void);
+uint32_t mflash_host_size(void);
+void mflash_host_get_stats(mflash_host_stats_t *stats);
+void mflash_host_reset_stats(void);
+
+#endif /* __MFLASH_DRV_H__ */
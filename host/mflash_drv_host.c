@@ -0,0 +1,218 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "logging_levels.h"
+#define LIBRARY_LOG_NAME "mflash_host"
+#define LIBRARY_LOG_LEVEL LOG_WARN
+#include "logging_stack.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mflash_drv.h"
+
+volatile uint32_t mflash_host_remap_offset;
+
+static uint8_t *flash_mem;
+static uint32_t flash_size;
+static int flash_fd = -1;
+static mflash_host_stats_t stats;
+
+/** Open the emulated flash.
+ *
+ * @param path backing file, created and erased if missing or too small.
+ *             NULL keeps the content in anonymous memory only.
+ * @param size flash size in bytes, multiple of MFLASH_SECTOR_SIZE
+ *
+ * @retval kStatus_Success: all OK
+ *         otherwise something failed
+ */
+status_t mflash_host_open(const char *path, uint32_t size)
+{
+    struct stat st;
+    off_t old_size = 0;
+
+    if (size == 0 || size % MFLASH_SECTOR_SIZE != 0)
+        return kStatus_InvalidArgument;
+
+    mflash_host_close();
+
+    if (path != NULL)
+    {
+        flash_fd = open(path, O_RDWR | O_CREAT, 0644);
+        if (flash_fd < 0 || fstat(flash_fd, &st) != 0)
+        {
+            LogError(("%s: unable to open %s", __func__, path));
+            mflash_host_close();
+            return kStatus_Fail;
+        }
+        old_size = st.st_size;
+        if (old_size < size && ftruncate(flash_fd, size) != 0)
+        {
+            mflash_host_close();
+            return kStatus_Fail;
+        }
+        flash_mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, flash_fd, 0);
+    }
+    else
+    {
+        flash_mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+
+    if (flash_mem == MAP_FAILED)
+    {
+        flash_mem = NULL;
+        mflash_host_close();
+        return kStatus_Fail;
+    }
+
+    /* anything that was not backed by the file yet comes out of the factory erased */
+    if (old_size < size)
+        memset(flash_mem + old_size, 0xff, size - old_size);
+
+    flash_size = size;
+    mflash_host_reset_stats();
+    return kStatus_Success;
+}
+
+void mflash_host_close(void)
+{
+    if (flash_mem != NULL)
+    {
+        if (flash_fd >= 0)
+            msync(flash_mem, flash_size, MS_SYNC);
+        munmap(flash_mem, flash_size);
+    }
+    if (flash_fd >= 0)
+        close(flash_fd);
+
+    flash_mem  = NULL;
+    flash_size = 0;
+    flash_fd   = -1;
+}
+
+uint8_t *mflash_host_memory(void)
+{
+    return flash_mem;
+}
+
+uint32_t mflash_host_size(void)
+{
+    return flash_size;
+}
+
+void mflash_host_get_stats(mflash_host_stats_t *out)
+{
+    *out = stats;
+}
+
+void mflash_host_reset_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+/** Initialize the emulated flash, if not done yet by mflash_host_open().
+ *  The MFLASH_HOST_FILE environment variable selects a backing file.
+ */
+int32_t mflash_drv_init(void)
+{
+    if (flash_mem != NULL)
+        return kStatus_Success;
+
+    return mflash_host_open(getenv("MFLASH_HOST_FILE"), MFLASH_HOST_DEFAULT_SIZE);
+}
+
+int32_t mflash_drv_sector_erase(uint32_t sector_addr)
+{
+    if (flash_mem == NULL && mflash_drv_init() != kStatus_Success)
+        return kStatus_Fail;
+
+    if (sector_addr % MFLASH_SECTOR_SIZE != 0 || sector_addr >= flash_size)
+    {
+        LogError(("%s: invalid sector address 0x%X", __func__, sector_addr));
+        return kStatus_InvalidArgument;
+    }
+
+    memset(flash_mem + sector_addr, 0xff, MFLASH_SECTOR_SIZE);
+    stats.sector_erases++;
+    return kStatus_Success;
+}
+
+int32_t mflash_drv_page_program(uint32_t page_addr, uint32_t *data)
+{
+    const uint8_t *src = (const uint8_t *)data;
+    uint8_t *dst;
+    uint32_t i;
+
+    if (flash_mem == NULL && mflash_drv_init() != kStatus_Success)
+        return kStatus_Fail;
+
+    if (page_addr % MFLASH_PAGE_SIZE != 0 || page_addr >= flash_size || (uintptr_t)data % 4 != 0)
+    {
+        LogError(("%s: invalid page address 0x%X", __func__, page_addr));
+        return kStatus_InvalidArgument;
+    }
+
+    dst = flash_mem + page_addr;
+
+    /* programming can only clear bits, data expecting a 1 over a 0 would be silently lost on a real part */
+    for (i = 0; i < MFLASH_PAGE_SIZE; i++)
+    {
+        if ((src[i] & ~dst[i]) != 0)
+        {
+            LogError(("%s: programming 0x%02X over 0x%02X at 0x%X requires an erase", __func__, src[i], dst[i],
+                      page_addr + i));
+            stats.violations++;
+            return kStatus_Fail;
+        }
+    }
+
+    for (i = 0; i < MFLASH_PAGE_SIZE; i++)
+        dst[i] &= src[i];
+
+    stats.page_programs++;
+    return kStatus_Success;
+}
+
+int32_t mflash_drv_read(uint32_t addr, uint32_t *buffer, uint32_t len)
+{
+    if (flash_mem == NULL && mflash_drv_init() != kStatus_Success)
+        return kStatus_Fail;
+
+    /* same restrictions as the FlexSPI IP command based driver */
+    if (addr % 4 != 0 || len % 4 != 0 || (uintptr_t)buffer % 4 != 0 || addr + len > flash_size || addr + len < addr)
+    {
+        LogError(("%s: invalid read 0x%X len %u", __func__, addr, len));
+        return kStatus_InvalidArgument;
+    }
+
+    memcpy(buffer, flash_mem + addr, len);
+    stats.reads++;
+    stats.read_bytes += len;
+    return kStatus_Success;
+}
+
+void *mflash_drv_phys2log(uint32_t addr, uint32_t len)
+{
+    if (flash_mem == NULL || addr + len > flash_size)
+        return NULL;
+
+    return flash_mem + addr;
+}
+
+uint32_t mflash_drv_log2phys(void *ptr, uint32_t len)
+{
+    uintptr_t off = (uintptr_t)ptr - (uintptr_t)flash_mem;
+
+    if (flash_mem == NULL || (uint8_t *)ptr < flash_mem || off + len > flash_size)
+        return 0xFFFFFFFFUL;
+
+    return (uint32_t)off;
+}
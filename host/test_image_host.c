@@ -0,0 +1,75 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "test_image_host.h"
+#include "mcuboot_app_support.h"
+#include "mflash_drv.h"
+
+/* Security counter, a protected TLV MCUboot knows of */
+#define TEST_IMAGE_TLV_SEC_CNT 0x50
+
+/** Write an image with a SHA256 TLV at the given physical offset of the
+ *  emulated flash, bypassing the flash driver.
+ *
+ * @retval size of the image, header and TLV areas included
+ */
+uint32_t test_image_write(uint32_t offset, const test_image_t *img)
+{
+    uint8_t *p = mflash_host_memory() + offset;
+    mbedtls_sha256_context sha;
+    struct image_header hdr;
+    struct image_tlv_info info;
+    struct image_tlv tlv;
+    uint32_t pos;
+    uint32_t i;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.ih_magic            = IMAGE_MAGIC;
+    hdr.ih_hdr_size         = TEST_IMAGE_HDR_SIZE;
+    hdr.ih_protect_tlv_size = img->prot_tlv_size;
+    hdr.ih_img_size         = img->body_size;
+    hdr.ih_ver.iv_major     = 1;
+    hdr.ih_ver.iv_build_num = img->build_num;
+
+    memset(p, 0, TEST_IMAGE_HDR_SIZE);
+    memcpy(p, &hdr, sizeof(hdr));
+    pos = TEST_IMAGE_HDR_SIZE;
+
+    for (i = 0; i < img->body_size; i++)
+        p[pos++] = (uint8_t)(i * 7 + img->seed);
+
+    if (img->prot_tlv_size > 0)
+    {
+        info.it_magic   = IMAGE_TLV_PROT_INFO_MAGIC;
+        info.it_tlv_tot = img->prot_tlv_size;
+        memcpy(p + pos, &info, sizeof(info));
+
+        tlv.it_type = TEST_IMAGE_TLV_SEC_CNT;
+        tlv._pad    = 0;
+        tlv.it_len  = img->prot_tlv_size - sizeof(info) - sizeof(tlv);
+        memcpy(p + pos + sizeof(info), &tlv, sizeof(tlv));
+        memset(p + pos + sizeof(info) + sizeof(tlv), img->seed, tlv.it_len);
+        pos += img->prot_tlv_size;
+    }
+
+    info.it_magic   = IMAGE_TLV_INFO_MAGIC;
+    info.it_tlv_tot = sizeof(info) + sizeof(tlv) + BL_SHA256_DIGEST_SIZE;
+    tlv.it_type     = IMAGE_TLV_SHA256;
+    tlv._pad        = 0;
+    tlv.it_len      = BL_SHA256_DIGEST_SIZE;
+    memcpy(p + pos, &info, sizeof(info));
+    memcpy(p + pos + sizeof(info), &tlv, sizeof(tlv));
+
+    /* header, body and protected TLVs are hashed */
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts_ret(&sha, 0);
+    mbedtls_sha256_update_ret(&sha, p, pos);
+    mbedtls_sha256_finish_ret(&sha, p + pos + sizeof(info) + sizeof(tlv));
+    mbedtls_sha256_free(&sha);
+
+    return pos + info.it_tlv_tot;
+}
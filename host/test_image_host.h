@@ -0,0 +1,30 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*
+ * MCUboot images built on the host and placed straight into the emulated
+ * flash, as a programming tool would, for the host tests and benchmark.
+ */
+
+#ifndef __TEST_IMAGE_HOST_H__
+#define __TEST_IMAGE_HOST_H__
+
+#include "fsl_common.h"
+
+#define TEST_IMAGE_HDR_SIZE 0x100
+
+typedef struct
+{
+    uint32_t body_size;     /* bytes of payload after the header */
+    uint32_t prot_tlv_size; /* 0 for none, else at least 8 bytes of protected TLV area */
+    uint32_t build_num;
+    uint8_t seed;           /* payload pattern */
+} test_image_t;
+
+uint32_t test_image_write(uint32_t offset, const test_image_t *img);
+
+#endif
@@ -0,0 +1,298 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*
+ * Unit tests of mcuboot_app_support.c on the emulated flash: image
+ * verification, slot state derived from the trailers and trailer writes.
+ * Run by ctest, each test starting from an erased flash.
+ */
+
+#include <stdio.h>
+
+#include "flash_wear.h"
+#include "mcuboot_app_support.h"
+#include "mflash_drv.h"
+#include "partition_table.h"
+#include "test_image_host.h"
+
+static int failures;
+
+#define TEST_CHECK(cond)                                                             \
+    do                                                                               \
+    {                                                                                \
+        if (!(cond))                                                                 \
+        {                                                                            \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                              \
+        }                                                                            \
+    } while (0)
+
+static void test_reset_flash(void)
+{
+    (void)mflash_host_open(NULL, MFLASH_HOST_DEFAULT_SIZE);
+    mflash_host_reset_stats();
+    bl_verify_mark_verified(0, 0);
+    bl_invalidate_image_state();
+}
+
+static struct image_trailer *test_trailer(uint32_t slot)
+{
+    const partition_entry_t *e = partition_slot(0, slot);
+
+    return (struct image_trailer *)(mflash_host_memory() + e->offset + e->size - sizeof(struct image_trailer));
+}
+
+/* What MCUboot leaves in the primary slot trailer when it boots an image under test */
+static void test_bootloader_swapped(void)
+{
+    struct image_trailer *t = test_trailer(PARTITION_SLOT_PRIMARY);
+
+    memcpy(t->magic, boot_img_magic, sizeof(t->magic));
+    t->copy_done = BOOT_FLAG_SET;
+    bl_invalidate_image_state();
+}
+
+static uint32_t test_state(void)
+{
+    uint32_t state = kSwapType_Max;
+
+    TEST_CHECK(bl_get_image_state(&state) == kStatus_Success);
+    return state;
+}
+
+static void test_verify_image(void)
+{
+    const partition_entry_t *slot = partition_slot(0, PARTITION_SLOT_SECONDARY);
+    const uint8_t *image          = (const uint8_t *)(uintptr_t)slot->offset;
+    test_image_t img              = {.body_size = 20000, .build_num = 7, .seed = 1};
+    partition_t ptn;
+    uint32_t size;
+
+    test_reset_flash();
+    TEST_CHECK(bl_verify_image(image, slot->size) == 0);
+
+    size = test_image_write(slot->offset, &img);
+    TEST_CHECK(bl_verify_image(image, slot->size) == 1);
+    TEST_CHECK(bl_verify_image(image, size) == 1);
+
+    /* truncated */
+    TEST_CHECK(bl_verify_image(image, size - 1) == 0);
+    TEST_CHECK(bl_verify_image(image, TEST_IMAGE_HDR_SIZE) == 0);
+
+    /* bad payload */
+    mflash_host_memory()[slot->offset + TEST_IMAGE_HDR_SIZE + 1000] ^= 0x01;
+    TEST_CHECK(bl_verify_image(image, slot->size) == 0);
+
+    /* unless it was checked while being written */
+    bl_verify_mark_verified(slot->offset, slot->size);
+    TEST_CHECK(bl_verify_image(image, slot->size) == 1);
+    bl_verify_mark_verified(0, 0);
+
+    /* but not once the slot is handed out again, for a write without slot_writer */
+    bl_verify_mark_verified(slot->offset, slot->size);
+    TEST_CHECK(bl_get_update_partition_info(&ptn) == kStatus_Success);
+    TEST_CHECK(bl_verify_image(image, slot->size) == 0);
+
+    bl_verify_mark_verified(slot->offset, slot->size);
+    bl_invalidate_image_state();
+    TEST_CHECK(bl_verify_image(image, slot->size) == 0);
+
+    /* bad header */
+    size = test_image_write(slot->offset, &img);
+    mflash_host_memory()[slot->offset] ^= 0x01;
+    TEST_CHECK(bl_verify_image(image, slot->size) == 0);
+
+    /* protected TLVs are covered by the hash */
+    img.prot_tlv_size = 16;
+    size              = test_image_write(slot->offset, &img);
+    TEST_CHECK(bl_verify_image(image, slot->size) == 1);
+    TEST_CHECK(bl_verify_image(image, size - 1) == 0);
+
+    mflash_host_memory()[slot->offset + TEST_IMAGE_HDR_SIZE + img.body_size + 10] ^= 0x01;
+    TEST_CHECK(bl_verify_image(image, slot->size) == 0);
+
+    test_image_write(slot->offset, &img);
+    mflash_host_memory()[slot->offset + TEST_IMAGE_HDR_SIZE + img.body_size] ^= 0x01;
+    TEST_CHECK(bl_verify_image(image, slot->size) == 0);
+}
+
+static void test_trailer_states(void)
+{
+    bl_image_state_t info;
+    partition_t ptn;
+
+    test_reset_flash();
+    TEST_CHECK(test_state() == kSwapType_None);
+    TEST_CHECK(bl_get_update_partition_info(&ptn) == kStatus_Success);
+    TEST_CHECK(ptn.start == partition_slot(0, PARTITION_SLOT_SECONDARY)->offset);
+
+    /* nothing to confirm */
+    TEST_CHECK(bl_update_image_state(kSwapType_Permanent) == kStatus_NoData);
+    TEST_CHECK(bl_update_image_state(kSwapType_Fail) == kStatus_InvalidArgument);
+
+    /* swap request, only seen by the bootloader with flash remapping */
+    TEST_CHECK(bl_update_image_state(kSwapType_ReadyForTest) == kStatus_Success);
+    TEST_CHECK(bl_get_image_state_info(&info) == kStatus_Success);
+    TEST_CHECK(memcmp(info.trailer[1].magic, boot_img_magic, sizeof(info.trailer[1].magic)) == 0);
+    TEST_CHECK(info.trailer[1].image_ok == 0xff && info.trailer[1].copy_done == 0xff);
+    TEST_CHECK(info.swap_state == kSwapType_None);
+
+    /* image under test, no update meanwhile */
+    test_bootloader_swapped();
+    TEST_CHECK(test_state() == kSwapType_Testing);
+    TEST_CHECK(bl_get_update_partition_info(&ptn) == kStatus_Fail);
+
+    TEST_CHECK(bl_update_image_state(kSwapType_Permanent) == kStatus_Success);
+    TEST_CHECK(test_state() == kSwapType_None);
+    TEST_CHECK(test_trailer(PARTITION_SLOT_PRIMARY)->image_ok == BOOT_FLAG_SET);
+    TEST_CHECK(bl_get_update_partition_info(&ptn) == kStatus_Success);
+
+    /* confirming twice is harmless */
+    TEST_CHECK(bl_update_image_state(kSwapType_Permanent) == kStatus_Success);
+    TEST_CHECK(test_state() == kSwapType_None);
+}
+
+/* Sectors erased and pages programmed since the last call, the writes of the
+ * flash wear log excluded (bl_update_image_state() logs the counters) */
+static void test_flash_ops(uint32_t *erases, uint32_t *programs)
+{
+    static flash_wear_counter_t last;
+    const flash_wear_counter_t *c;
+    flash_wear_counter_t total = {0};
+    flash_wear_t wear;
+
+    flash_wear_get(&wear);
+    for (c = &wear.counters.slot[0][0]; c < &wear.counters.other + 1; c++)
+    {
+        total.erases += c->erases;
+        total.programs += c->programs;
+    }
+
+    *erases   = total.erases - last.erases;
+    *programs = total.programs - last.programs;
+    last      = total;
+}
+
+static void test_trailer_journal(void)
+{
+    mflash_host_stats_t stats;
+    uint32_t erases;
+    uint32_t programs;
+
+    test_reset_flash();
+    test_flash_ops(&erases, &programs);
+
+    /* the magic is programmed over the erased trailer */
+    TEST_CHECK(bl_update_image_state(kSwapType_ReadyForTest) == kStatus_Success);
+    test_flash_ops(&erases, &programs);
+    TEST_CHECK(erases == 0 && programs == 1);
+
+    /* same content, nothing written */
+    TEST_CHECK(bl_update_image_state(kSwapType_ReadyForTest) == kStatus_Success);
+    test_flash_ops(&erases, &programs);
+    TEST_CHECK(erases == 0 && programs == 0);
+
+    /* image_ok over an erased byte */
+    test_bootloader_swapped();
+    TEST_CHECK(bl_update_image_state(kSwapType_Permanent) == kStatus_Success);
+    test_flash_ops(&erases, &programs);
+    TEST_CHECK(erases == 0 && programs == 1);
+
+    /* image_ok back to erased takes a sector erase */
+    test_trailer(PARTITION_SLOT_SECONDARY)->image_ok = BOOT_FLAG_SET;
+    bl_invalidate_image_state();
+    TEST_CHECK(bl_update_image_state(kSwapType_ReadyForTest) == kStatus_Success);
+    test_flash_ops(&erases, &programs);
+    TEST_CHECK(erases == 1 && programs == 1);
+    TEST_CHECK(test_trailer(PARTITION_SLOT_SECONDARY)->image_ok == 0xff);
+
+    /* the counters were logged each time the trailer changed */
+    mflash_host_get_stats(&stats);
+    TEST_CHECK(stats.page_programs == 3 + 3);
+    TEST_CHECK(stats.violations == 0);
+}
+
+static void test_build_num(void)
+{
+    const partition_entry_t *slot = partition_slot(0, PARTITION_SLOT_SECONDARY);
+    test_image_t img              = {.body_size = 1000, .build_num = 41};
+    uint32_t build_num;
+
+    test_reset_flash();
+    test_image_write(slot->offset, &img);
+    TEST_CHECK(bl_get_image_build_num(&build_num, 2) == kStatus_Success && build_num == 41);
+
+    /* new image written without slot_writer, queries being served from RAM
+     * until it is verified */
+    img.build_num = 42;
+    test_image_write(slot->offset, &img);
+    TEST_CHECK(bl_get_image_build_num(&build_num, 2) == kStatus_Success && build_num == 41);
+    TEST_CHECK(bl_verify_image((const uint8_t *)(uintptr_t)slot->offset, slot->size) == 1);
+    TEST_CHECK(bl_get_image_build_num(&build_num, 2) == kStatus_Success && build_num == 42);
+}
+
+static void test_image_info(void)
+{
+    const partition_entry_t *slot = partition_slot(0, PARTITION_SLOT_SECONDARY);
+    const uint8_t *image          = (const uint8_t *)(uintptr_t)slot->offset;
+    test_image_t img              = {.body_size = 1000, .build_num = 5, .seed = 1};
+    uint8_t digest[BL_SHA256_DIGEST_SIZE];
+    uint8_t first[BL_SHA256_DIGEST_SIZE];
+    bl_image_info_t info;
+
+    test_reset_flash();
+    TEST_CHECK(bl_get_image_info(0, PARTITION_SLOT_SECONDARY, &info) == kStatus_Success && !info.present);
+
+    /* written without slot_writer, known once verified */
+    test_image_write(slot->offset, &img);
+    TEST_CHECK(bl_get_image_info(0, PARTITION_SLOT_SECONDARY, &info) == kStatus_Success && !info.present);
+    TEST_CHECK(bl_verify_image(image, slot->size) == 1);
+    TEST_CHECK(bl_get_image_info(0, PARTITION_SLOT_SECONDARY, &info) == kStatus_Success && info.present &&
+               info.has_digest && info.ih_ver.iv_build_num == 5);
+    TEST_CHECK(bl_get_image_digest(slot->offset, first) == kStatus_Success);
+    TEST_CHECK(memcmp(first, info.digest, sizeof(first)) == 0);
+
+    /* same header, other payload */
+    img.seed = 2;
+    test_image_write(slot->offset, &img);
+    TEST_CHECK(bl_verify_image(image, slot->size) == 1);
+    TEST_CHECK(bl_get_image_digest(slot->offset, digest) == kStatus_Success);
+    TEST_CHECK(memcmp(first, digest, sizeof(first)) != 0);
+
+    /* slot blanked, the verification failing */
+    memset(mflash_host_memory() + slot->offset, 0xff, TEST_IMAGE_HDR_SIZE);
+    TEST_CHECK(bl_verify_image(image, slot->size) == 0);
+    TEST_CHECK(bl_get_image_digest(slot->offset, digest) == kStatus_NoData);
+    TEST_CHECK(bl_get_image_info(0, PARTITION_SLOT_SECONDARY, &info) == kStatus_Success && !info.present);
+}
+
+int main(void)
+{
+    static const struct
+    {
+        const char *name;
+        void (*run)(void);
+    } tests[] = {
+        {"verify_image", test_verify_image},
+        {"trailer_states", test_trailer_states},
+        {"trailer_journal", test_trailer_journal},
+        {"build_num", test_build_num},
+        {"image_info", test_image_info},
+    };
+    int before;
+    uint32_t i;
+
+    for (i = 0; i < ARRAY_SIZE(tests); i++)
+    {
+        before = failures;
+        tests[i].run();
+        printf("%-16s %s\n", tests[i].name, failures == before ? "ok" : "FAILED");
+    }
+
+    mflash_host_close();
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "logging_levels.h"
+#define LIBRARY_LOG_NAME "decompress"
+#define LIBRARY_LOG_LEVEL LOG_INFO
+#include "logging_stack.h"
+
+#include <string.h>
+
+#include "image_decompress.h"
+
+enum
+{
+    kDecompressState_Header,
+    kDecompressState_Tag,
+    kDecompressState_Literal,
+    kDecompressState_Index,
+    kDecompressState_Count,
+};
+
+#define WINDOW_MASK(ctx) ((1U << (ctx)->hdr.window_bits) - 1)
+
+/* Pass the decompressed data not yet written to the slot writer */
+static status_t image_decompress_flush(image_decompress_t *ctx)
+{
+    uint32_t start = ctx->flushed & WINDOW_MASK(ctx);
+    uint32_t len   = ctx->produced - ctx->flushed;
+
+    if (len == 0)
+        return kStatus_Success;
+
+    ctx->flushed = ctx->produced;
+    return slot_writer_write(&ctx->writer, &ctx->window[start], len);
+}
+
+/* Append a decompressed byte, flushing the window each time it wraps */
+static status_t image_decompress_emit(image_decompress_t *ctx, uint8_t byte)
+{
+    if (ctx->produced >= ctx->hdr.size)
+    {
+        LogError(("Decompressed data exceeds the image size of %u bytes", ctx->hdr.size));
+        return kStatus_OutOfRange;
+    }
+
+    ctx->window[ctx->produced & WINDOW_MASK(ctx)] = byte;
+    ctx->produced++;
+
+    if ((ctx->produced & WINDOW_MASK(ctx)) == 0)
+        return image_decompress_flush(ctx);
+
+    return kStatus_Success;
+}
+
+/* Start reading a value of count bits from the stream */
+static void image_decompress_expect(image_decompress_t *ctx, uint32_t state, uint32_t count)
+{
+    ctx->state     = state;
+    ctx->bits      = 0;
+    ctx->bit_count = count;
+}
+
+/* Handle a complete value read from the bit stream */
+static status_t image_decompress_value(image_decompress_t *ctx)
+{
+    status_t status = kStatus_Success;
+    uint32_t count;
+
+    switch (ctx->state)
+    {
+        case kDecompressState_Tag:
+            if (ctx->bits)
+                image_decompress_expect(ctx, kDecompressState_Literal, 8);
+            else
+                image_decompress_expect(ctx, kDecompressState_Index, ctx->hdr.window_bits);
+            break;
+
+        case kDecompressState_Literal:
+            status = image_decompress_emit(ctx, (uint8_t)ctx->bits);
+            image_decompress_expect(ctx, kDecompressState_Tag, 1);
+            break;
+
+        case kDecompressState_Index:
+            ctx->offset = ctx->bits + 1;
+            image_decompress_expect(ctx, kDecompressState_Count, ctx->hdr.lookahead_bits);
+            break;
+
+        case kDecompressState_Count:
+            for (count = ctx->bits + 1; count > 0 && status == kStatus_Success; count--)
+                status = image_decompress_emit(ctx, ctx->window[(ctx->produced - ctx->offset) & WINDOW_MASK(ctx)]);
+            image_decompress_expect(ctx, kDecompressState_Tag, 1);
+            break;
+    }
+
+    return status;
+}
+
+static status_t image_decompress_check_header(image_decompress_t *ctx)
+{
+    image_compress_header_t *hdr = &ctx->hdr;
+
+    if (hdr->magic != IMAGE_COMPRESS_MAGIC)
+    {
+        LogError(("Invalid compressed image magic 0x%X", hdr->magic));
+        return kStatus_Fail;
+    }
+
+    if (hdr->window_bits < 4 || hdr->window_bits > IMAGE_DECOMPRESS_MAX_WINDOW_BITS || hdr->lookahead_bits < 3 ||
+        hdr->lookahead_bits >= hdr->window_bits)
+    {
+        LogError(("Unsupported compression parameters %u/%u", hdr->window_bits, hdr->lookahead_bits));
+        return kStatus_Fail;
+    }
+
+    if (hdr->size > ctx->writer.ptn.size)
+    {
+        LogError(("Compressed image of %u bytes does not fit in the slot", hdr->size));
+        return kStatus_OutOfRange;
+    }
+
+    LogInfo(("Decompressing %u bytes image, window %u/%u", hdr->size, 1U << hdr->window_bits,
+             1U << hdr->lookahead_bits));
+    return kStatus_Success;
+}
+
+/** Prepare decompressing an image into the slot returned by bl_get_update_partition_info()
+ *
+ * @retval kStatus_Success: all OK
+ *         otherwise the update slot is not available
+ */
+status_t image_decompress_init(image_decompress_t *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->state = kDecompressState_Header;
+
+    return slot_writer_init(&ctx->writer);
+}
+
+/** Feed the next chunk of the compressed image, of any size
+ *
+ * @retval kStatus_Success: all OK so far
+ *         otherwise the stream is invalid or writing failed
+ */
+status_t image_decompress_write(image_decompress_t *ctx, const uint8_t *data, uint32_t len)
+{
+    uint32_t n;
+    int bit;
+
+    if (ctx->status == kStatus_Success && ctx->state == kDecompressState_Header)
+    {
+        n = MIN(len, sizeof(ctx->hdr) - ctx->received);
+        memcpy((uint8_t *)&ctx->hdr + ctx->received, data, n);
+        ctx->received += n;
+        data += n;
+        len -= n;
+
+        if (ctx->received == sizeof(ctx->hdr))
+        {
+            ctx->status = image_decompress_check_header(ctx);
+            image_decompress_expect(ctx, kDecompressState_Tag, 1);
+        }
+    }
+
+    for (; ctx->status == kStatus_Success && len > 0; data++, len--)
+    {
+        /* most significant bit first */
+        for (bit = 7; bit >= 0 && ctx->status == kStatus_Success; bit--)
+        {
+            /* zero padding after the last byte */
+            if (ctx->produced == ctx->hdr.size)
+                break;
+
+            ctx->bits = (ctx->bits << 1) | ((*data >> bit) & 1);
+            if (--ctx->bit_count == 0)
+                ctx->status = image_decompress_value(ctx);
+        }
+        ctx->received++;
+    }
+
+    /* keep the slot writer busy with whatever is decompressed */
+    if (ctx->status == kStatus_Success)
+        ctx->status = image_decompress_flush(ctx);
+
+    return ctx->status;
+}
+
+/** Complete the image once the whole compressed stream was fed, see slot_writer_finish()
+ *
+ * @retval kStatus_Success: image is decompressed and valid
+ *         otherwise something failed
+ */
+status_t image_decompress_finish(image_decompress_t *ctx)
+{
+    if (ctx->status != kStatus_Success)
+        return ctx->status;
+
+    if (ctx->state == kDecompressState_Header || ctx->produced != ctx->hdr.size)
+    {
+        LogError(("Truncated compressed image, %u of %u bytes produced", ctx->produced, ctx->hdr.size));
+        return kStatus_Fail;
+    }
+
+    return slot_writer_finish(&ctx->writer);
+}
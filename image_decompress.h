@@ -0,0 +1,57 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef __IMAGE_DECOMPRESS_H__
+#define __IMAGE_DECOMPRESS_H__
+
+#include "fsl_common.h"
+#include "slot_writer.h"
+
+/*
+ * Compressed image format, as produced by armgcc/compress_image.py:
+ *
+ *   image_compress_header_t (little endian)
+ *   heatshrink (LZSS) bit stream, with the window and lookahead sizes given in
+ *   the header, padded with zero bits to a whole byte
+ */
+#define IMAGE_COMPRESS_MAGIC 0x53484b41 /* "AKHS" */
+
+/* Largest window supported, the decompression context holds a window this big */
+#ifndef IMAGE_DECOMPRESS_MAX_WINDOW_BITS
+#define IMAGE_DECOMPRESS_MAX_WINDOW_BITS 11
+#endif
+
+typedef struct
+{
+    uint32_t magic;
+    uint8_t window_bits;    /* log2 of the back-reference window size */
+    uint8_t lookahead_bits; /* log2 of the longest back-reference */
+    uint16_t reserved;
+    uint32_t size;          /* size of the decompressed (signed) image */
+} image_compress_header_t;
+
+/* Decompresses an image into the candidate slot, verifying it on the fly */
+typedef struct
+{
+    slot_writer_t writer;
+    image_compress_header_t hdr;
+    uint32_t received;  /* compressed bytes received so far */
+    uint32_t produced;  /* decompressed bytes so far, also the window write position */
+    uint32_t flushed;   /* decompressed bytes passed to the slot writer */
+    uint32_t state;
+    uint32_t bits;      /* value being read from the bit stream */
+    uint32_t bit_count; /* bits still to be read for that value */
+    uint32_t offset;    /* back-reference distance */
+    status_t status;
+    uint8_t window[1 << IMAGE_DECOMPRESS_MAX_WINDOW_BITS];
+} image_decompress_t;
+
+status_t image_decompress_init(image_decompress_t *ctx);
+status_t image_decompress_write(image_decompress_t *ctx, const uint8_t *data, uint32_t len);
+status_t image_decompress_finish(image_decompress_t *ctx);
+
+#endif
@@ -0,0 +1,268 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "logging_levels.h"
+#define LIBRARY_LOG_NAME "image_decrypt"
+#define LIBRARY_LOG_LEVEL LOG_INFO
+#include "logging_stack.h"
+
+#include <string.h>
+
+#include "image_decrypt.h"
+#include "mcuboot_app_support.h"
+#include "mbedtls/platform_util.h"
+
+#define AES_BLOCK_SIZE 16
+
+/* Keystream computed per accelerator job */
+#define KEYSTREAM_BLOCKS 32
+#define KEYSTREAM_SIZE   (KEYSTREAM_BLOCKS * AES_BLOCK_SIZE)
+
+/* Counter blocks and keystream, read and written by the accelerator, so kept
+ * out of the data cache. Only one image is decrypted at a time. */
+#if defined(MBEDTLS_FREESCALE_DCP_AES) || defined(MBEDTLS_FREESCALE_CAAM_AES)
+AT_NONCACHEABLE_SECTION_ALIGN(static uint8_t counter_blocks[KEYSTREAM_SIZE], 16);
+AT_NONCACHEABLE_SECTION_ALIGN(static uint8_t keystream[KEYSTREAM_SIZE], 16);
+#else
+static uint8_t counter_blocks[KEYSTREAM_SIZE];
+static uint8_t keystream[KEYSTREAM_SIZE];
+#endif
+
+/* AES-KW (RFC 3394) unwrap of the image key with the built-in key encryption key */
+static status_t image_decrypt_unwrap(const uint8_t *wrapped, uint8_t key[IMAGE_DECRYPT_KEY_SIZE])
+{
+    static const uint8_t kw_iv[8] = {0xa6, 0xa6, 0xa6, 0xa6, 0xa6, 0xa6, 0xa6, 0xa6};
+    const uint32_t n = IMAGE_DECRYPT_KEY_SIZE / 8;
+    mbedtls_aes_context aes;
+    uint8_t b[AES_BLOCK_SIZE];
+    status_t status = kStatus_Success;
+    int32_t j;
+    uint32_t i;
+
+    mbedtls_aes_init(&aes);
+    if (mbedtls_aes_setkey_dec(&aes, image_enc_kek, IMAGE_DECRYPT_KEY_SIZE * 8) != 0)
+    {
+        mbedtls_aes_free(&aes);
+        return kStatus_Fail;
+    }
+
+    memcpy(b, wrapped, 8);
+    memcpy(key, wrapped + 8, IMAGE_DECRYPT_KEY_SIZE);
+
+    for (j = 5; j >= 0 && status == kStatus_Success; j--)
+    {
+        for (i = n; i >= 1; i--)
+        {
+            /* A ^ t with t = n * j + i, which fits in the last byte */
+            b[7] ^= (uint8_t)(n * j + i);
+            memcpy(b + 8, key + (i - 1) * 8, 8);
+            if (mbedtls_aes_crypt_ecb(&aes, MBEDTLS_AES_DECRYPT, b, b) != 0)
+            {
+                status = kStatus_Fail;
+                break;
+            }
+            memcpy(key + (i - 1) * 8, b + 8, 8);
+        }
+    }
+
+    mbedtls_aes_free(&aes);
+
+    if (status == kStatus_Success && memcmp(b, kw_iv, sizeof(kw_iv)) != 0)
+    {
+        LogError(("Image key unwrap failed, wrong key encryption key"));
+        status = kStatus_Fail;
+    }
+
+    mbedtls_platform_zeroize(b, sizeof(b));
+    if (status != kStatus_Success)
+        mbedtls_platform_zeroize(key, IMAGE_DECRYPT_KEY_SIZE);
+
+    return status;
+}
+
+/* Encrypt the counter blocks into the keystream */
+static status_t image_decrypt_keystream(image_decrypt_t *ctx, uint32_t size)
+{
+#if defined(MBEDTLS_FREESCALE_DCP_AES)
+    return DCP_AES_EncryptEcb(DCP, &ctx->dcp, counter_blocks, keystream, size);
+#elif defined(MBEDTLS_FREESCALE_CAAM_AES)
+    caam_handle_t caam = {.jobRing = kCAAM_JobRing0};
+
+    return CAAM_AES_EncryptEcb(CAAM, &caam, counter_blocks, keystream, size, ctx->key, IMAGE_DECRYPT_KEY_SIZE);
+#else
+    uint32_t off;
+
+    for (off = 0; off < size; off += AES_BLOCK_SIZE)
+    {
+        if (mbedtls_aes_crypt_ecb(&ctx->aes, MBEDTLS_AES_ENCRYPT, counter_blocks + off, keystream + off) != 0)
+            return kStatus_Fail;
+    }
+    return kStatus_Success;
+#endif
+}
+
+/* Load the image key into the cipher */
+static status_t image_decrypt_setkey(image_decrypt_t *ctx)
+{
+#if defined(MBEDTLS_FREESCALE_DCP_AES)
+    /* the key travels with each job, leaving the key slots to mbedTLS */
+    ctx->dcp.channel    = kDCP_Channel1;
+    ctx->dcp.keySlot    = kDCP_PayloadKey;
+    ctx->dcp.swapConfig = kDCP_NoSwap;
+    return DCP_AES_SetKey(DCP, &ctx->dcp, ctx->key, IMAGE_DECRYPT_KEY_SIZE);
+#elif defined(MBEDTLS_FREESCALE_CAAM_AES)
+    return kStatus_Success;
+#else
+    return mbedtls_aes_setkey_enc(&ctx->aes, ctx->key, IMAGE_DECRYPT_KEY_SIZE * 8) == 0 ? kStatus_Success :
+                                                                                           kStatus_Fail;
+#endif
+}
+
+void image_decrypt_init(image_decrypt_t *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+#if !defined(MBEDTLS_FREESCALE_DCP_AES) && !defined(MBEDTLS_FREESCALE_CAAM_AES)
+    mbedtls_aes_init(&ctx->aes);
+#endif
+}
+
+void image_decrypt_free(image_decrypt_t *ctx)
+{
+#if !defined(MBEDTLS_FREESCALE_DCP_AES) && !defined(MBEDTLS_FREESCALE_CAAM_AES)
+    mbedtls_aes_free(&ctx->aes);
+#endif
+    mbedtls_platform_zeroize(ctx, sizeof(*ctx));
+}
+
+/** Get the image key from the end of the image, before the payload is written.
+ *  The key TLV follows the encrypted payload, so the tail of the image has to
+ *  be fetched first, e.g. with an HTTP Range request.
+ *
+ * @param tail last bytes of the image, covering at least its unprotected TLV area
+ *
+ * @retval kStatus_Success: the key is known
+ *         kStatus_NoData: the image has no IMAGE_TLV_ENC_KW128 TLV
+ *         otherwise the TLVs are malformed or the key cannot be unwrapped
+ */
+status_t image_decrypt_set_tail(image_decrypt_t *ctx, const uint8_t *tail, uint32_t len)
+{
+    struct image_tlv_info info;
+    bl_tlv_index_t index;
+    const uint8_t *wrapped;
+    uint32_t off;
+    status_t status;
+
+    /* the unprotected TLV area is the one ending the image */
+    for (off = 0; off + sizeof(info) <= len; off++)
+    {
+        memcpy(&info, tail + off, sizeof(info));
+        if (info.it_magic == IMAGE_TLV_INFO_MAGIC && off + info.it_tlv_tot == len)
+            break;
+    }
+    if (off + sizeof(info) > len)
+    {
+        LogError(("%s: no TLV area found at the end of the image", __func__));
+        return kStatus_Fail;
+    }
+
+    status = bl_tlv_index_build(&index, tail + off, len - off);
+    if (status != kStatus_Success)
+        return status;
+
+    wrapped = bl_tlv_find(&index, tail + off, kBlTlv_EncKw128, IMAGE_DECRYPT_WRAPPED_SIZE);
+    if (wrapped == NULL)
+        return kStatus_NoData;
+
+    status = image_decrypt_unwrap(wrapped, ctx->key);
+    if (status == kStatus_Success)
+        status = image_decrypt_setkey(ctx);
+
+    ctx->key_valid = status == kStatus_Success;
+    return status;
+}
+
+/** Set up the decryption from the image header, once it is received
+ *
+ * @retval kStatus_Success: all OK, the payload is decrypted if the image is encrypted
+ *         otherwise the header is malformed
+ */
+status_t image_decrypt_set_header(image_decrypt_t *ctx, const struct image_header *hdr)
+{
+    ctx->encrypted = IS_ENCRYPTED(hdr) != 0;
+    if (!ctx->encrypted)
+        return kStatus_Success;
+
+    if (hdr->ih_hdr_size < IMAGE_HEADER_SIZE || hdr->ih_hdr_size + hdr->ih_img_size < hdr->ih_hdr_size)
+        return kStatus_Fail;
+
+    ctx->body_start = hdr->ih_hdr_size;
+    ctx->body_end   = hdr->ih_hdr_size + hdr->ih_img_size;
+    LogInfo(("Image of %lu bytes is encrypted", hdr->ih_img_size));
+    return kStatus_Success;
+}
+
+/** Decrypt a chunk of the image in place. Parts outside of the payload are
+ *  left as they are, as is everything before image_decrypt_set_header().
+ *
+ * @param offset offset of data in the image
+ *
+ * @retval kStatus_Success: all OK
+ *         otherwise the key is unknown or the accelerator failed
+ */
+status_t image_decrypt_update(image_decrypt_t *ctx, uint32_t offset, uint8_t *data, uint32_t len)
+{
+    uint32_t pos;
+    uint32_t end;
+    uint32_t block;
+    uint32_t skip;
+    uint32_t n;
+    uint32_t i;
+    status_t status;
+
+    if (!ctx->encrypted)
+        return kStatus_Success;
+
+    pos = MAX(offset, ctx->body_start);
+    end = MIN(offset + len, ctx->body_end);
+
+    if (pos < end && !ctx->key_valid)
+    {
+        LogError(("Image is encrypted and its key is unknown"));
+        return kStatus_Fail;
+    }
+
+    while (pos < end)
+    {
+        /* MCUboot uses a zero nonce, the counter is the payload block number */
+        block = (pos - ctx->body_start) / AES_BLOCK_SIZE;
+        skip  = (pos - ctx->body_start) % AES_BLOCK_SIZE;
+        n     = MIN(end - pos, KEYSTREAM_SIZE - skip);
+
+        memset(counter_blocks, 0, KEYSTREAM_SIZE);
+        for (i = 0; i * AES_BLOCK_SIZE < skip + n; i++)
+        {
+            counter_blocks[i * AES_BLOCK_SIZE + 12] = (uint8_t)((block + i) >> 24);
+            counter_blocks[i * AES_BLOCK_SIZE + 13] = (uint8_t)((block + i) >> 16);
+            counter_blocks[i * AES_BLOCK_SIZE + 14] = (uint8_t)((block + i) >> 8);
+            counter_blocks[i * AES_BLOCK_SIZE + 15] = (uint8_t)(block + i);
+        }
+
+        status = image_decrypt_keystream(ctx, i * AES_BLOCK_SIZE);
+        if (status != kStatus_Success)
+        {
+            LogError(("%s: keystream computation failed: %d", __func__, status));
+            return status;
+        }
+
+        for (i = 0; i < n; i++)
+            data[pos - offset + i] ^= keystream[skip + i];
+
+        pos += n;
+    }
+
+    return kStatus_Success;
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef __IMAGE_DECRYPT_H__
+#define __IMAGE_DECRYPT_H__
+
+#include "fsl_common.h"
+#include "image.h"
+#include "mbedtls/aes.h"
+
+/*
+ * Decryption of MCUboot encrypted images (IMAGE_F_ENCRYPTED) while they are
+ * written: the payload is AES-128-CTR encrypted with a random key, itself
+ * wrapped with AES-KW-128 in the IMAGE_TLV_ENC_KW128 TLV.
+ *
+ * The key encryption key is built in (AKNANO_IMAGE_ENC_KEY). The keystream is
+ * computed by the DCP (RT1060) or the CAAM (RT1170) when mbedTLS is set up to
+ * use them, by mbedTLS otherwise.
+ *
+ * Slots receive the decrypted image, so the bootloader must be built without
+ * MCUBOOT_ENC_IMAGES.
+ */
+#define IMAGE_DECRYPT_KEY_SIZE     16
+#define IMAGE_DECRYPT_WRAPPED_SIZE (IMAGE_DECRYPT_KEY_SIZE + 8)
+
+/* Key encryption key, as defined by the AKNANO_IMAGE_ENC_KEY source file */
+extern const uint8_t image_enc_kek[IMAGE_DECRYPT_KEY_SIZE];
+
+typedef struct
+{
+    bool key_valid;
+    bool encrypted;      /* the header has IMAGE_F_ENCRYPTED */
+    uint32_t body_start; /* encrypted payload, as image offsets */
+    uint32_t body_end;
+    uint8_t key[IMAGE_DECRYPT_KEY_SIZE];
+#if defined(MBEDTLS_FREESCALE_DCP_AES)
+    dcp_handle_t dcp;
+#elif !defined(MBEDTLS_FREESCALE_CAAM_AES)
+    mbedtls_aes_context aes;
+#endif
+} image_decrypt_t;
+
+void image_decrypt_init(image_decrypt_t *ctx);
+void image_decrypt_free(image_decrypt_t *ctx);
+status_t image_decrypt_set_tail(image_decrypt_t *ctx, const uint8_t *tail, uint32_t len);
+status_t image_decrypt_set_header(image_decrypt_t *ctx, const struct image_header *hdr);
+status_t image_decrypt_update(image_decrypt_t *ctx, uint32_t offset, uint8_t *data, uint32_t len);
+
+#endif
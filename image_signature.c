@@ -0,0 +1,134 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "logging_levels.h"
+#define LIBRARY_LOG_NAME "image_signature"
+#define LIBRARY_LOG_LEVEL LOG_INFO
+#include "logging_stack.h"
+
+#include <string.h>
+
+#include "image_signature.h"
+#include "mbedtls/pk.h"
+#include "mbedtls/rsa.h"
+
+/* Generated by "imgtool.py getpub", DER encoded as MCUboot expects it:
+ * PKCS#1 RSAPublicKey for RSA, SubjectPublicKeyInfo for ECDSA */
+#ifdef AKNANO_IMAGE_SIGNATURE_RSA2048
+extern const unsigned char rsa_pub_key[];
+extern const unsigned int rsa_pub_key_len;
+#define SIGNING_KEY         rsa_pub_key
+#define SIGNING_KEY_LEN     rsa_pub_key_len
+#define SIGNATURE_TLV       kBlTlv_Rsa2048Pss
+#define SIGNATURE_TYPE_NAME "RSA2048-PSS"
+#else
+extern const unsigned char ecdsa_pub_key[];
+extern const unsigned int ecdsa_pub_key_len;
+#define SIGNING_KEY         ecdsa_pub_key
+#define SIGNING_KEY_LEN     ecdsa_pub_key_len
+#define SIGNATURE_TLV       kBlTlv_Ecdsa256
+#define SIGNATURE_TYPE_NAME "ECDSA256"
+#endif
+
+/* MCUboot signs with a PSS salt as long as the hash */
+#define RSA_PSS_SALT_LEN BL_SHA256_DIGEST_SIZE
+
+/* Parsed once, on first use */
+static mbedtls_pk_context signing_key;
+static uint8_t signing_key_hash[BL_SHA256_DIGEST_SIZE];
+static bool signing_key_valid;
+
+static status_t image_signature_load_key(void)
+{
+    if (signing_key_valid)
+        return kStatus_Success;
+
+    if (mbedtls_sha256_ret(SIGNING_KEY, SIGNING_KEY_LEN, signing_key_hash, 0) != 0)
+        return kStatus_Fail;
+
+    mbedtls_pk_init(&signing_key);
+    if (mbedtls_pk_parse_public_key(&signing_key, SIGNING_KEY, SIGNING_KEY_LEN) != 0)
+    {
+        LogError(("%s: invalid embedded %s public key", __func__, SIGNATURE_TYPE_NAME));
+        mbedtls_pk_free(&signing_key);
+        return kStatus_Fail;
+    }
+
+    signing_key_valid = true;
+    return kStatus_Success;
+}
+
+/** Check the image signature TLV against the embedded public key
+ *
+ * @param index index of the unprotected TLV area of the image
+ * @param area unprotected TLV area
+ * @param hash SHA256 of the image, already checked against the SHA256 TLV
+ *
+ * @retval kStatus_Success: the image is signed with the embedded key
+ *         otherwise the image would be rejected by the bootloader
+ */
+status_t image_signature_verify(const bl_tlv_index_t *index, const uint8_t *area,
+                                const uint8_t hash[BL_SHA256_DIGEST_SIZE])
+{
+    const uint8_t *key_hash;
+    const uint8_t *sig;
+    uint16_t sig_len;
+    int ret;
+
+    if (image_signature_load_key() != kStatus_Success)
+        return kStatus_Fail;
+
+    /* same key selection as MCUboot */
+    key_hash = bl_tlv_find(index, area, kBlTlv_KeyHash, BL_SHA256_DIGEST_SIZE);
+    if (key_hash == NULL)
+    {
+        LogError(("Image validation failed, no KEYHASH TLV found"));
+        return kStatus_Fail;
+    }
+    if (memcmp(key_hash, signing_key_hash, BL_SHA256_DIGEST_SIZE) != 0)
+    {
+        LogError(("Image validation failed, image is not signed with the embedded key"));
+        return kStatus_Fail;
+    }
+
+    sig_len = index->len[SIGNATURE_TLV];
+    sig     = bl_tlv_find(index, area, SIGNATURE_TLV, sig_len);
+    if (sig == NULL)
+    {
+        LogError(("Image validation failed, no %s TLV found", SIGNATURE_TYPE_NAME));
+        return kStatus_Fail;
+    }
+
+#ifdef AKNANO_IMAGE_SIGNATURE_RSA2048
+    {
+        mbedtls_pk_rsassa_pss_options pss = {
+            .mgf1_hash_id      = MBEDTLS_MD_SHA256,
+            .expected_salt_len = RSA_PSS_SALT_LEN,
+        };
+
+        if (sig_len != mbedtls_pk_get_len(&signing_key))
+        {
+            LogError(("Image validation failed, unexpected signature size %u", sig_len));
+            return kStatus_Fail;
+        }
+
+        ret = mbedtls_pk_verify_ext(MBEDTLS_PK_RSASSA_PSS, &pss, &signing_key, MBEDTLS_MD_SHA256, hash,
+                                    BL_SHA256_DIGEST_SIZE, sig, sig_len);
+    }
+#else
+    /* DER encoded (r, s) */
+    ret = mbedtls_pk_verify(&signing_key, MBEDTLS_MD_SHA256, hash, BL_SHA256_DIGEST_SIZE, sig, sig_len);
+#endif
+    if (ret != 0)
+    {
+        LogError(("Image validation failed, invalid %s signature (-0x%X)", SIGNATURE_TYPE_NAME, -ret));
+        return kStatus_Fail;
+    }
+
+    LogInfo(("Image %s signature is valid", SIGNATURE_TYPE_NAME));
+    return kStatus_Success;
+}
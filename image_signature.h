@@ -0,0 +1,27 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef __IMAGE_SIGNATURE_H__
+#define __IMAGE_SIGNATURE_H__
+
+#include "fsl_common.h"
+#include "mcuboot_app_support.h"
+
+/*
+ * Check of the MCUboot signature of an image, with the public key embedded in
+ * the application. Enabled by AKNANO_IMAGE_SIGNATURE_RSA2048 (RSA-2048 PSS,
+ * imgtool default) or AKNANO_IMAGE_SIGNATURE_ECDSA256, the key being the C file
+ * generated by "imgtool.py getpub" for the key images are signed with.
+ */
+#if defined(AKNANO_IMAGE_SIGNATURE_RSA2048) || defined(AKNANO_IMAGE_SIGNATURE_ECDSA256)
+#define AKNANO_IMAGE_SIGNATURE
+#endif
+
+status_t image_signature_verify(const bl_tlv_index_t *index, const uint8_t *area,
+                                const uint8_t hash[BL_SHA256_DIGEST_SIZE]);
+
+#endif
@@ -47,8 +47,12 @@
 #include "platform/iot_threads.h"
 #include "types/iot_network_types.h"
 #include "aws_demo.h"
+#ifdef AKNANO_FLASH_BENCHMARK
+#include "flash_benchmark.h"
+#endif
 
 #include "aknano_public_api.h"
+#include "erase_ahead.h"
 
 #ifdef AKNANO_BOARD_MODEL_RT1170
 #if BOARD_NETWORK_USE_100M_ENET_PORT
@@ -72,6 +76,7 @@
 #include "fsl_iomuxc.h"
 #include "fsl_enet.h"
 #include "fsl_silicon_id.h"
+#include "flexspi_flash_config.h"
 
 #ifdef AKNANO_BOARD_MODEL_RT1060
 // #include "fsl_enet_mdio.h"
@@ -284,6 +289,8 @@ int initNetwork(void)
         {
         }
     }
+    /* keep receiving frames while the flash is programmed or erased */
+    flexspi_nor_live_irqs_init();
     ret = netifapi_netif_set_default(&netif);
     if (ret != (err_t)ERR_OK)
     {
@@ -367,6 +374,9 @@ void vApplicationDaemonTaskStartupHook(void)
 
     if (SYSTEM_Init() == pdPASS)
     {
+#ifdef AKNANO_FLASH_BENCHMARK
+        flash_bench_run();
+#endif
         if (initNetwork() != 0)
         {
             configPRINTF(("Network init failed, stopping demo.\r\n"));
@@ -464,6 +474,7 @@ int main(void)
 
         // if( xTaskCreate( prvLoggingTask, "Logging", usStackSize, NULL, uxPriority, NULL ) == pdPASS )
     xTaskCreate(btn_read_task, "btn_read_task", 2048, NULL, btn_press_task_PRIO, NULL);
+    erase_ahead_init();
 #ifdef AKNANO_ENABLE_AWS_MQTT_DEMO_TASK
     xTaskCreate(aws_mqtt_starter, "aws_mqtt_starter", 8 * 1024, NULL, configMAX_PRIORITIES - 1, NULL);
 #endif
@@ -15,13 +15,23 @@
 
 #include "mcuboot_app_support.h"
 #include "mflash_drv.h"
+#include "flexspi_flash_config.h"
+#include "mbedtls/sha256.h"
+#include "download_progress.h"
+#include "erase_ahead.h"
+#include "flash_wear.h"
+#include "image_signature.h"
+#include "partition_table.h"
+#include "update_txn.h"
 // #include "sblconfig.h"
 
+#ifndef FLASH_REMAP_OFFSET_REG /* the host flash emulator provides its own */
 #ifdef AKNANO_BOARD_MODEL_RT1170
 #define FLASH_REMAP_OFFSET_REG 0x400CC428 /* RT1170 flash remap offset register */
 #else
 #define FLASH_REMAP_OFFSET_REG 0x400AC080 /* RT1060 flash remap offset register */
 #endif
+#endif
 
 
 #include "fsl_debug_console.h"
@@ -33,114 +43,90 @@ const uint32_t boot_img_magic[] = {
     0x8079b62c,
 };
 
-#define PRIMARY_SLOT_ACTIVE   0
-#define SECONDARY_SLOT_ACTIVE 1
+/* Size of the chunks used when hashing an image straight from flash */
+#define BL_VERIFY_CHUNK_SIZE MFLASH_SECTOR_SIZE
 
-/** Find out what slot is currently booted.
- *
- * @retval PRIMARY_SLOT_ACTIVE: image is running from primary slot
- *         SECONDARY_SLOT_ACTIVE: image is running from secondary slot
- */
-uint32_t get_active_image(void)
-{
-#ifdef CONFIG_MCUBOOT_FLASH_REMAP_ENABLE
-    uint32_t offset;
-
-    offset = *((volatile uint32_t *)FLASH_REMAP_OFFSET_REG);
-    if (offset > 0)
-        return SECONDARY_SLOT_ACTIVE;
-    else
-        return PRIMARY_SLOT_ACTIVE;
+#ifdef AKNANO_FLASH_EDMA
+/* one chunk is read by eDMA while the other one is hashed, aligned on D-cache lines */
+SDK_ALIGN(static uint32_t verify_buf[2][BL_VERIFY_CHUNK_SIZE / sizeof(uint32_t)], 32);
 #else
-    extern int main(void);
-    uintptr_t main_addr = (uintptr_t)main;
-    if (main_addr > BOOT_FLASH_ACT_APP && main_addr < BOOT_FLASH_CAND_APP)
-        return PRIMARY_SLOT_ACTIVE;
-    else
-        return SECONDARY_SLOT_ACTIVE;
+/* word aligned so that flash_read() can copy directly into it */
+static uint32_t verify_buf[BL_VERIFY_CHUNK_SIZE / sizeof(uint32_t)];
 #endif
+
+/* Image already checked by an incremental verifier while it was being written */
+static partition_t verified_image;
+
+/* TLV types indexed by bl_tlv_index_build(), in kBlTlv_[...] order */
+static const uint8_t bl_tlv_types[kBlTlv_Max] = {
+    IMAGE_TLV_KEYHASH,     IMAGE_TLV_SHA256,      IMAGE_TLV_RSA2048_PSS,
+    IMAGE_TLV_ECDSA256,    IMAGE_TLV_ENC_RSA2048, IMAGE_TLV_ENC_KW128,
+};
+
+/* Header and TLVs of the image last verified or queried */
+static bl_image_tlvs_t image_tlvs;
+
+/* Image state, read from flash on first use and kept until a trailer is rewritten */
+static bl_image_state_t image_state;
+static bool image_state_valid;
+
+/* Image metadata by image number and slot, read on first use and dropped with the image state */
+static bl_image_info_t image_info[PARTITION_MAX_IDS][2];
+static bool image_info_valid[PARTITION_MAX_IDS][2];
+
+/* Cached trailers, headers and image metadata are read again on next use */
+static void bl_drop_image_cache(void)
+{
+    image_state_valid = false;
+    memset(image_info_valid, 0, sizeof(image_info_valid));
 }
 
-/** This wrapper function deals with mflash driver limitations such as unaligned
- *  access to memory, copying data into unaligned destination and data size is
- *  not multiplies of 4.
+/** Find out what slot is currently booted.
  *
- * @retval kStatus_Success: all OK
- *         otherwise something failed
+ * @retval PRIMARY_SLOT_ACTIVE: image is running from primary slot
+ *         SECONDARY_SLOT_ACTIVE: image is running from secondary slot
  */
-#ifdef CONFIG_MCUBOOT_FLASH_REMAP_ENABLE
-static int32_t mflash_drv_read_wrapper(uint32_t addr, void *dst, uint32_t len)
+uint32_t get_active_image(void)
 {
-    /* temporary buffer size has to be multiple of 4! */
-    static uint32_t tmp_buf[64 / sizeof(uint32_t)];
-    status_t status;
-    uint32_t chunkAlign_cnt = 0;
-    uint32_t offset         = addr;
-    uint8_t *dst_ptr        = (uint8_t *)dst;
+    /* the booted slot cannot change before the next reboot */
+    static int32_t active_image = -1;
 
-    /* Correction for unaligned start address offset*/
-    if (len > 0 && (addr % 4 != 0))
+    if (active_image < 0)
     {
-        uint32_t cor         = addr % 4;
-        uint32_t restTo4     = 4 - cor;
-        uint32_t segment_len = (len >= 4 ? restTo4 : len);
-
-        /* read whole 4B and copy desired segment to destination*/
-        status = mflash_drv_read(offset - cor, tmp_buf, 4);
-        if (status != kStatus_Success)
-            return status;
-        memcpy(dst_ptr, (uint8_t *)tmp_buf + cor, segment_len);
+#ifdef CONFIG_MCUBOOT_FLASH_REMAP_ENABLE
+        uint32_t offset;
 
-        /* correct offset address, destination pointer and remaining data size */
-        offset += restTo4;
-        dst_ptr += restTo4;
-        if (restTo4 > len)
-        {
-            len = 0;
-        }
+        offset = *((volatile uint32_t *)FLASH_REMAP_OFFSET_REG);
+        if (offset > 0)
+            active_image = SECONDARY_SLOT_ACTIVE;
         else
-        {
-            len -= restTo4;
-        }
-    }
-
-    while (len > 0)
-    {
-        size_t chunk = (len > sizeof(tmp_buf)) ? sizeof(tmp_buf) : len;
-        /* mflash demands size to be in multiples of 4 */
-        size_t chunkAlign4 = (chunk + 3) & (~3);
-
-        /* directly copy into destination if address and data size is aligned */
-        if ((uint32_t)dst_ptr % 4 == 0 && chunk % 4 == 0)
-        {
-            status = mflash_drv_read(offset, (uint32_t *)(dst_ptr + chunkAlign_cnt * sizeof(tmp_buf)), chunkAlign4);
-        }
+            active_image = PRIMARY_SLOT_ACTIVE;
+#else
+        extern int main(void);
+        uintptr_t main_addr              = (uintptr_t)main;
+        const partition_entry_t *primary = partition_slot(0, PARTITION_SLOT_PRIMARY);
+        if (main_addr > BOOT_FLASH_BASE + primary->offset && main_addr < BOOT_FLASH_BASE + primary->offset + primary->size)
+            active_image = PRIMARY_SLOT_ACTIVE;
         else
-        {
-            status = mflash_drv_read(offset, tmp_buf, chunkAlign4);
-            memcpy(dst_ptr + chunkAlign_cnt * sizeof(tmp_buf), (uint8_t *)tmp_buf, chunk);
-        }
-
-        if (status != kStatus_Success)
-        {
-            return status;
-        }
-
-        len -= chunk;
-        offset += chunk;
-        chunkAlign_cnt++;
+            active_image = SECONDARY_SLOT_ACTIVE;
+#endif
     }
 
-    return kStatus_Success;
+    return (uint32_t)active_image;
 }
-#endif /* CONFIG_MCUBOOT_FLASH_REMAP_ENABLE */
 
 static int32_t flash_read(uint32_t addr, uint32_t *buffer, uint32_t len)
 {
     uint8_t *buffer_u8 = (uint8_t *)buffer;
 
-    /* inter-page lenght of the first read can be smaller than page size */
+#if defined(MFLASH_PAGE_INTEGRITY_CHECKS) && MFLASH_PAGE_INTEGRITY_CHECKS
+    /* readability is checked page by page, the inter-page lenght of the
+     * first read can be smaller than page size */
     size_t plen = MFLASH_PAGE_SIZE - (addr % MFLASH_PAGE_SIZE);
+#else
+    /* whole range at once, the lower layers split it as needed */
+    size_t plen = len;
+#endif
 
     while (len > 0)
     {
@@ -155,32 +141,54 @@ static int32_t flash_read(uint32_t addr, uint32_t *buffer, uint32_t len)
         else
 #endif
         {
-#ifdef CONFIG_MCUBOOT_FLASH_REMAP_ENABLE
-            /* flash remapped memory is accessible by FlexSpi peripheral */
-            if (mflash_drv_read_wrapper(addr, (uint32_t *)buffer_u8, readsize) != kStatus_Success)
-            {
-                return -1;
-            }
-#else
-            void *flash_ptr = mflash_drv_phys2log(addr, readsize);
-            if (flash_ptr == NULL)
+            /* AHB reads, except for remapped and freshly written ranges which
+             * go through the FlexSpi peripheral */
+            if (sfw_flash_read(addr, buffer_u8, readsize) != kStatus_Success)
             {
                 return -1;
             }
-            /* use direct memcpy as mflash_drv_read low layer may expects len to be word aligned */
-            memcpy(buffer_u8, flash_ptr, readsize);
-#endif /* CONFIG_MCUBOOT_FLASH_REMAP_ENABLE */
         }
 
         len -= readsize;
         addr += readsize;
         buffer_u8 += readsize;
 
+#if defined(MFLASH_PAGE_INTEGRITY_CHECKS) && MFLASH_PAGE_INTEGRITY_CHECKS
         plen = MFLASH_PAGE_SIZE;
+#endif
     }
 
     return 0;
 }
+
+/** Read from flash, the address being the physical offset from the flash base.
+ *  Unaligned addresses, destinations and sizes are supported.
+ *
+ * @retval 0: all OK
+ *         otherwise something failed
+ */
+int32_t bl_flash_read(uint32_t addr, void *buffer, uint32_t len)
+{
+    return flash_read(addr, buffer, len);
+}
+
+/** CRC32 (IEEE 802.3) of a buffer, as used by the records kept in flash */
+uint32_t bl_crc32(const void *data, uint32_t len)
+{
+    const uint8_t *p = data;
+    uint32_t crc     = 0xffffffff;
+    int i;
+
+    while (len--)
+    {
+        crc ^= *p++;
+        for (i = 0; i < 8; i++)
+            crc = (crc >> 1) ^ (0xedb88320 & (0U - (crc & 1)));
+    }
+
+    return ~crc;
+}
+
 #ifndef CONFIG_MCUBOOT_FLASH_REMAP_ENABLE
 static int check_unset(uint8_t *p, int len)
 {
@@ -218,40 +226,110 @@ static int boot_img_magic_check(uint8_t *p)
     return 0;
 }
 
-static status_t boot_swap_test(void)
+/* Slot of the application that is not running, PARTITION_SLOT_[...] */
+static uint32_t bl_other_slot(void)
+{
+    return get_active_image() == PRIMARY_SLOT_ACTIVE ? PARTITION_SLOT_SECONDARY : PARTITION_SLOT_PRIMARY;
+}
+
+/* Physical offset of the end of an application slot, where its trailer lies */
+static uint32_t bl_slot_end(uint32_t slot)
+{
+    const partition_entry_t *e = partition_slot(0, slot);
+
+    return e->offset + e->size;
+}
+
+/** Write the last page of a slot, holding its trailer.
+ *  In trailer journal mode, the page is programmed over its current content
+ *  when that only clears bits (e.g. setting image_ok or the magic over erased
+ *  bytes), the sector being erased only when some bit has to go back to 1.
+ *
+ * @param slot_end physical offset of the end of the slot
+ * @param buf new content of the last page of the slot
+ *
+ * @retval kStatus_Success: all OK
+ *         otherwise something failed
+ */
+static status_t boot_write_trailer(uint32_t slot_end, uint32_t *buf)
 {
-    uint32_t off;
     status_t status;
 
-    uint32_t buf[MFLASH_PAGE_SIZE / 4]; /* ensure the buffer is word aligned */
-    struct image_trailer *image_trailer_p =
-        (struct image_trailer *)((uint8_t *)buf + MFLASH_PAGE_SIZE - sizeof(struct image_trailer));
+#ifdef CONFIG_MCUBOOT_TRAILER_JOURNAL
+    uint32_t cur[MFLASH_PAGE_SIZE / 4];
+    uint32_t set_bits = 0;
+    bool same         = true;
+    int i;
 
-    if (get_active_image() == PRIMARY_SLOT_ACTIVE)
-        off = FLASH_AREA_IMAGE_2_OFFSET + FLASH_AREA_IMAGE_2_SIZE;
-    else
-        off = FLASH_AREA_IMAGE_1_OFFSET + FLASH_AREA_IMAGE_1_SIZE;
+    status = flash_read(slot_end - MFLASH_PAGE_SIZE, cur, MFLASH_PAGE_SIZE);
+    if (status != kStatus_Success)
+    {
+        LogError(("%s: failed to read trailer at 0x%X", __func__, slot_end));
+        return status;
+    }
 
-    memset(buf, 0xff, MFLASH_PAGE_SIZE);
-    memcpy(image_trailer_p->magic, boot_img_magic, sizeof(boot_img_magic));
+    for (i = 0; i < MFLASH_PAGE_SIZE / 4; i++)
+    {
+        set_bits |= buf[i] & ~cur[i];
+        same = same && buf[i] == cur[i];
+    }
+
+    if (same)
+        return kStatus_Success;
+
+    erase_ahead_mark_written(slot_end - MFLASH_PAGE_SIZE, MFLASH_PAGE_SIZE);
+    if (set_bits == 0)
+    {
+        status = flexspi_nor_flash_program(UPDATE_EXAMPLE_FLEXSPI, slot_end - MFLASH_PAGE_SIZE, buf, MFLASH_PAGE_SIZE);
+        sfw_flash_written(slot_end - MFLASH_PAGE_SIZE, MFLASH_PAGE_SIZE);
+        if (status != kStatus_Success)
+            LogError(("%s: failed to update trailer at 0x%X", __func__, slot_end));
+        return status;
+    }
+#endif
 
-    status = mflash_drv_sector_erase(off - MFLASH_SECTOR_SIZE);
+    status = flexspi_nor_flash_erase_sector(UPDATE_EXAMPLE_FLEXSPI, slot_end - MFLASH_SECTOR_SIZE);
+    sfw_flash_written(slot_end - MFLASH_SECTOR_SIZE, MFLASH_SECTOR_SIZE);
     if (status != kStatus_Success)
     {
-        LogError(("%s: failed to erase trailer2", __func__));
+        LogError(("%s: failed to erase trailer at 0x%X", __func__, slot_end));
         return status;
     }
 
-    status = mflash_drv_page_program(off - MFLASH_PAGE_SIZE, buf);
+    erase_ahead_mark_written(slot_end - MFLASH_PAGE_SIZE, MFLASH_PAGE_SIZE);
+    status = flexspi_nor_flash_program(UPDATE_EXAMPLE_FLEXSPI, slot_end - MFLASH_PAGE_SIZE, buf, MFLASH_PAGE_SIZE);
+    sfw_flash_written(slot_end - MFLASH_PAGE_SIZE, MFLASH_PAGE_SIZE);
     if (status != kStatus_Success)
     {
-        LogError(("%s: failed to write trailer2", __func__));
+        LogError(("%s: failed to write trailer at 0x%X", __func__, slot_end));
         return status;
     }
 
     return status;
 }
 
+static status_t boot_swap_test(void)
+{
+    uint32_t off;
+    status_t status;
+
+    uint32_t buf[MFLASH_PAGE_SIZE / 4]; /* ensure the buffer is word aligned */
+    struct image_trailer *image_trailer_p =
+        (struct image_trailer *)((uint8_t *)buf + MFLASH_PAGE_SIZE - sizeof(struct image_trailer));
+
+    off = bl_slot_end(bl_other_slot());
+
+    memset(buf, 0xff, MFLASH_PAGE_SIZE);
+    memcpy(image_trailer_p->magic, boot_img_magic, sizeof(boot_img_magic));
+
+    /* the trailer is rewritten, whatever the outcome */
+    bl_invalidate_image_state();
+
+    status = boot_write_trailer(off, buf);
+
+    return status;
+}
+
 /*
  * ToDo: Rework broken function. Marking itself or just downloaded one?
  */
@@ -264,25 +342,16 @@ status_t boot_swap_perm(void)
     struct image_trailer *image_trailer_p =
         (struct image_trailer *)((uint8_t *)buf + MFLASH_PAGE_SIZE - sizeof(struct image_trailer));
 
-    off = FLASH_AREA_IMAGE_2_OFFSET + FLASH_AREA_IMAGE_2_SIZE;
+    off = bl_slot_end(PARTITION_SLOT_SECONDARY);
 
     memset(buf, 0xff, MFLASH_PAGE_SIZE);
     memcpy(image_trailer_p->magic, boot_img_magic, sizeof(boot_img_magic));
     image_trailer_p->image_ok = BOOT_FLAG_SET;
 
-    status = mflash_drv_sector_erase(off - MFLASH_SECTOR_SIZE);
-    if (status != kStatus_Success)
-    {
-        LogError(("%s: failed to erase trailer2", __func__));
-        return status;
-    }
+    /* the trailer is rewritten, whatever the outcome */
+    bl_invalidate_image_state();
 
-    status = mflash_drv_page_program(off - MFLASH_PAGE_SIZE, buf);
-    if (status != kStatus_Success)
-    {
-        LogError(("%s: failed to write trailer2", __func__));
-        return status;
-    }
+    status = boot_write_trailer(off, buf);
 
     return status;
 }
@@ -296,14 +365,7 @@ static status_t boot_swap_ok(void)
     struct image_trailer *image_trailer_p =
         (struct image_trailer *)((uint8_t *)buf + MFLASH_PAGE_SIZE - sizeof(struct image_trailer));
 
-    if (get_active_image() == PRIMARY_SLOT_ACTIVE)
-    {
-        off_replace = FLASH_AREA_IMAGE_1_OFFSET + FLASH_AREA_IMAGE_1_SIZE;
-    }
-    else
-    {
-        off_replace = FLASH_AREA_IMAGE_2_OFFSET + FLASH_AREA_IMAGE_2_SIZE;
-    }
+    off_replace = bl_slot_end(get_active_image());
 
     status = flash_read(off_replace - MFLASH_PAGE_SIZE, buf, MFLASH_PAGE_SIZE);
     if (status != kStatus_Success)
@@ -330,39 +392,25 @@ static status_t boot_swap_ok(void)
     /* mark image ok */
     image_trailer_p->image_ok = BOOT_FLAG_SET;
 
-    /* erase trailer */
-    status = mflash_drv_sector_erase(off_replace - MFLASH_SECTOR_SIZE);
-    if (status != kStatus_Success)
-    {
-        LogError(("%s: failed to erase trailer1, __func__"));
-        return status;
-    }
+    /* the trailer is rewritten, whatever the outcome */
+    bl_invalidate_image_state();
 
-    /* write trailer */
-    status = mflash_drv_page_program(off_replace - MFLASH_PAGE_SIZE, buf);
+    /* write trailer, image_ok only clears bits of an erased byte */
+    status = boot_write_trailer(off_replace, buf);
     if (status != kStatus_Success)
-    {
-        LogError(("%s: failed to write trailer1, __func__"));
         return status;
-    }
 
 #if defined(CONFIG_MCUBOOT_FLASH_REMAP_DOWNGRADE_SUPPORT)
     /* downgrade support for DIRECT-XIP, erase header of inactive slot */
     /* because it can contains image with higher version */
     uint32_t off_header_erase;
 
-    if (get_active_image() == PRIMARY_SLOT_ACTIVE)
-    {
-        off_header_erase = FLASH_AREA_IMAGE_2_OFFSET;
-    }
-    else
-    {
-        off_header_erase = FLASH_AREA_IMAGE_1_OFFSET;
-    }
+    off_header_erase = partition_slot(0, bl_other_slot())->offset;
 
     LogInfo(("Deleting header of inactive image in %s slot (rollback support for direct-xip)",
-           off_header_erase == FLASH_AREA_IMAGE_1_OFFSET ? "primary" : "secondary"));
-    status = mflash_drv_sector_erase(off_header_erase);
+           bl_other_slot() == PARTITION_SLOT_PRIMARY ? "primary" : "secondary"));
+    status = flexspi_nor_flash_erase_sector(UPDATE_EXAMPLE_FLEXSPI, off_header_erase);
+    sfw_flash_written(off_header_erase, MFLASH_SECTOR_SIZE);
     if (status != kStatus_Success)
     {
         LogError(("%s: failed to erase header of inactive image, __func__"));
@@ -373,91 +421,537 @@ static status_t boot_swap_ok(void)
     return status;
 }
 
-int32_t bl_verify_image(const uint8_t *data, uint32_t size)
+/** Index the TLVs of interest of an unprotected TLV area in RAM
+ *
+ * @param area TLV area, starting with its image_tlv_info
+ * @param size number of bytes available at area
+ *
+ * @retval kStatus_Success: index is valid
+ *         otherwise the area is malformed or does not fit in size
+ */
+status_t bl_tlv_index_build(bl_tlv_index_t *index, const uint8_t *area, uint32_t size)
 {
-    struct image_header *ih;
-    struct image_tlv_info *it;
-    uint32_t decl_size;
-    const uint32_t offset = (uint32_t)data;
+    struct image_tlv_info it;
+    struct image_tlv tlv;
+    uint32_t off;
+    uint32_t i;
+
+    memset(index, 0, sizeof(*index));
 
-    /* Secure that buffer size is 4B aligned */
-    uint32_t buffer[(sizeof(struct image_header) / sizeof(uint32_t) + 3) & (~3)];
+    if (size < sizeof(it))
+        return kStatus_Fail;
 
-    if (flash_read(offset, (uint32_t *)buffer, sizeof(struct image_header)) != kStatus_Success)
+    memcpy(&it, area, sizeof(it));
+    if (it.it_magic != IMAGE_TLV_INFO_MAGIC)
     {
-        LogError(("Flash read failed"));
-        return 0;
+        LogError(("Image validation failed (it->it_magic != IMAGE_TLV_INFO_MAGIC) 0x%X 0x%X", it.it_magic,
+                  IMAGE_TLV_INFO_MAGIC));
+        return kStatus_Fail;
+    }
+    if (it.it_tlv_tot < sizeof(it) || it.it_tlv_tot > size)
+    {
+        LogError(("Image validation failed, unsupported TLV area size %u", it.it_tlv_tot));
+        return kStatus_Fail;
     }
 
-    ih = (struct image_header *)buffer;
+    for (off = sizeof(it); off + sizeof(tlv) <= it.it_tlv_tot; off += tlv.it_len)
+    {
+        memcpy(&tlv, area + off, sizeof(tlv));
+        off += sizeof(tlv);
+        if (off + tlv.it_len > it.it_tlv_tot)
+        {
+            LogError(("Image validation failed, TLV 0x%X overflows the TLV area", tlv.it_type));
+            return kStatus_Fail;
+        }
+
+        for (i = 0; i < kBlTlv_Max; i++)
+        {
+            /* the first occurrence wins, as in MCUboot */
+            if (tlv.it_type == bl_tlv_types[i] && index->off[i] == 0)
+            {
+                index->off[i] = off;
+                index->len[i] = tlv.it_len;
+            }
+        }
+    }
+
+    return kStatus_Success;
+}
+
+/** Get the value of an indexed TLV
+ *
+ * @param tlv kBlTlv_[...] entry
+ * @param len expected value length
+ *
+ * @retval pointer to the value in area, or NULL if absent or of another length
+ */
+const uint8_t *bl_tlv_find(const bl_tlv_index_t *index, const uint8_t *area, uint32_t tlv, uint16_t len)
+{
+    if (tlv >= kBlTlv_Max || index->off[tlv] == 0 || index->len[tlv] != len)
+        return NULL;
+
+    return area + index->off[tlv];
+}
+
+/** Read the header and the TLV areas of the image at the given physical offset,
+ *  the TLVs with a single flash read, and index the unprotected TLVs.
+ *
+ * @param size bytes available for the image from offset
+ *
+ * @retval kStatus_Success: img is valid
+ *         kStatus_NoData: there is no image at offset
+ *         otherwise the image is malformed or flash read failed
+ */
+status_t bl_read_image_tlvs(uint32_t offset, uint32_t size, bl_image_tlvs_t *img)
+{
+    struct image_header *ih = &img->hdr;
+    struct image_tlv_info it;
+    uint32_t tlv_off;
+    uint32_t len;
 
-    /* do we have at least the header */
     if (size < sizeof(struct image_header))
+        return kStatus_NoData;
+
+    if (flash_read(offset, (uint32_t *)ih, sizeof(struct image_header)) != kStatus_Success)
     {
-        return 0;
+        LogError(("Flash read failed"));
+        return kStatus_Fail;
     }
 
-    /* check magic number */
     if (ih->ih_magic != IMAGE_MAGIC)
+        return kStatus_NoData;
+
+    /* check that we have at least the amount of data declared by the header */
+    tlv_off = ih->ih_hdr_size + ih->ih_img_size;
+    if (size < tlv_off + ih->ih_protect_tlv_size + sizeof(struct image_tlv_info))
     {
-        LogError(("Image validation failed with magic=0x%X != 0x%X", (int)ih->ih_magic, IMAGE_MAGIC));
-        return 0;
+        LogError(("Image validation failed size (%lu) < decl_size (%lu)", size,
+                  tlv_off + ih->ih_protect_tlv_size + sizeof(struct image_tlv_info)));
+        return kStatus_Fail;
+    }
+    if (ih->ih_protect_tlv_size + sizeof(struct image_tlv_info) > sizeof(img->tlv))
+    {
+        LogError(("Image validation failed, unsupported protected TLV area size %u", ih->ih_protect_tlv_size));
+        return kStatus_Fail;
     }
 
-    /* check that we have at least the amount of data declared by the header */
-    decl_size = ih->ih_img_size + ih->ih_hdr_size + ih->ih_protect_tlv_size;
-    if (size < decl_size)
+    /* both TLV areas in one go, the unprotected one must fit in what is left */
+    len = MIN(size - tlv_off, sizeof(img->tlv));
+    if (flash_read(offset + tlv_off, img->tlv, len) != kStatus_Success)
     {
-        LogError(("Image validation failed size (%lu) < decl_size (%lu)", size, decl_size));
-        return 0;
+        LogError(("Flash read failed"));
+        return kStatus_Fail;
     }
 
     /* check protected TLVs if any */
     if (ih->ih_protect_tlv_size > 0)
     {
-        if (ih->ih_protect_tlv_size < sizeof(struct image_tlv_info))
+        memcpy(&it, img->tlv, sizeof(it));
+        if (ih->ih_protect_tlv_size < sizeof(struct image_tlv_info) || it.it_magic != IMAGE_TLV_PROT_INFO_MAGIC ||
+            it.it_tlv_tot != ih->ih_protect_tlv_size)
         {
-            LogError(("Image validation failed  ih->ih_protect_tlv_size (%u) < sizeof(struct image_tlv_info) (%u)", 
-            ih->ih_protect_tlv_size, sizeof(struct image_tlv_info)));
-            return 0;
+            LogError(("Image validation failed, invalid protected TLV area (magic 0x%X, size %u, expected %u)",
+                      it.it_magic, it.it_tlv_tot, ih->ih_protect_tlv_size));
+            return kStatus_Fail;
         }
-        if (flash_read(offset + ih->ih_img_size + ih->ih_hdr_size, (uint32_t *)buffer, sizeof(struct image_tlv_info)) !=
-            kStatus_Success)
+    }
+
+    img->unprot_off = ih->ih_protect_tlv_size;
+    memcpy(&it, (const uint8_t *)img->tlv + img->unprot_off, sizeof(it));
+    img->tlv_size = img->unprot_off + it.it_tlv_tot;
+    if (it.it_magic == IMAGE_TLV_INFO_MAGIC && img->tlv_size > len && len < sizeof(img->tlv))
+    {
+        LogError(("Image validation failed size (%lu) < TLV area end (%lu)", size, tlv_off + img->tlv_size));
+        return kStatus_Fail;
+    }
+
+    return bl_tlv_index_build(&img->index, (const uint8_t *)img->tlv + img->unprot_off, len - img->unprot_off);
+}
+
+/** Get the value of an unprotected TLV of an image read by bl_read_image_tlvs()
+ *
+ * @retval pointer to the value, or NULL if absent or of another length
+ */
+const uint8_t *bl_image_tlv(const bl_image_tlvs_t *img, uint32_t tlv, uint16_t len)
+{
+    return bl_tlv_find(&img->index, (const uint8_t *)img->tlv + img->unprot_off, tlv, len);
+}
+
+/** Compute the SHA256 of a flash region, reading it in BL_VERIFY_CHUNK_SIZE chunks.
+ *  mbedTLS is configured with the SHA256 ALT implementation, so hashing is
+ *  offloaded to DCP on RT1060 and CAAM on RT1170. With AKNANO_FLASH_EDMA, chunks
+ *  are read by eDMA through the IP bus, the next one while the current one is
+ *  hashed.
+ *
+ * @retval kStatus_Success: hash holds the digest of the region
+ *         otherwise something failed
+ */
+static status_t bl_hash_flash(uint32_t offset, uint32_t len, uint8_t hash[BL_SHA256_DIGEST_SIZE])
+{
+    mbedtls_sha256_context sha;
+    status_t status = kStatus_Success;
+#ifdef AKNANO_FLASH_EDMA
+    uint32_t chunk = MIN(len, BL_VERIFY_CHUNK_SIZE);
+    uint32_t hashed;
+    uint32_t cur = 0;
+    bool pending = false;
+#endif
+
+    mbedtls_sha256_init(&sha);
+    if (mbedtls_sha256_starts_ret(&sha, 0) != 0)
+        status = kStatus_Fail;
+
+#ifdef AKNANO_FLASH_EDMA
+    /* the background erase would issue flash commands in the middle of the reads */
+    erase_ahead_pause();
+
+    if (status == kStatus_Success && len > 0)
+    {
+        status  = sfw_flash_read_ipc_start(offset, verify_buf[cur], chunk);
+        pending = status == kStatus_Success;
+    }
+
+    while (pending)
+    {
+        hashed  = chunk;
+        pending = false;
+        status  = sfw_flash_read_ipc_wait();
+        if (status != kStatus_Success)
         {
-            LogError(("Flash read failed\n"));
-            return 0;
+            LogError(("%s: flash read failed at 0x%X", __func__, offset));
+            break;
         }
-        it = (struct image_tlv_info *)buffer;
-        if ((it->it_magic != IMAGE_TLV_PROT_INFO_MAGIC) || (it->it_tlv_tot != ih->ih_protect_tlv_size))
+
+        offset += chunk;
+        len -= chunk;
+
+        /* read the next chunk while this one is hashed */
+        if (len > 0)
         {
-            if (it->it_magic != IMAGE_TLV_PROT_INFO_MAGIC)
-                LogError(("Image validation failed it->it_magic (%X) != IMAGE_TLV_PROT_INFO_MAGIC (%X)",  
-                    (int)it->it_magic, IMAGE_TLV_PROT_INFO_MAGIC));
-            if (it->it_tlv_tot != ih->ih_protect_tlv_size)
-                LogError(("Image validation failed it->it_tlv_tot (%u) != ih->ih_protect_tlv_size (%u)",  
-                    it->it_tlv_tot, ih->ih_protect_tlv_size));
-            return 0;
+            chunk   = MIN(len, BL_VERIFY_CHUNK_SIZE);
+            status  = sfw_flash_read_ipc_start(offset, verify_buf[cur ^ 1], chunk);
+            pending = status == kStatus_Success;
+        }
+
+        if (mbedtls_sha256_update_ret(&sha, (const unsigned char *)verify_buf[cur], hashed) != 0)
+        {
+            if (pending)
+                (void)sfw_flash_read_ipc_wait();
+            status  = kStatus_Fail;
+            pending = false;
         }
+
+        cur ^= 1;
     }
 
-    /* check for optional TLVs following the image as declared by the header */
-    /* the struct is always present following firmware image or protected TLV*/
-    /* if protected area is present */
-    if (flash_read(offset + decl_size, (uint32_t *)buffer, sizeof(struct image_tlv_info)) != kStatus_Success)
+    erase_ahead_resume();
+#else
+    while (status == kStatus_Success && len > 0)
     {
-        LogError(("Flash read failed"));
+        uint32_t chunk = (len > sizeof(verify_buf)) ? sizeof(verify_buf) : len;
+
+        if (flash_read(offset, verify_buf, chunk) != kStatus_Success)
+        {
+            LogError(("%s: flash read failed at 0x%X", __func__, offset));
+            status = kStatus_Fail;
+            break;
+        }
+
+        if (mbedtls_sha256_update_ret(&sha, (const unsigned char *)verify_buf, chunk) != 0)
+            status = kStatus_Fail;
+
+        offset += chunk;
+        len -= chunk;
+    }
+#endif
+
+    if (status == kStatus_Success && mbedtls_sha256_finish_ret(&sha, hash) != 0)
+        status = kStatus_Fail;
+
+    mbedtls_sha256_free(&sha);
+    return status;
+}
+
+/** Reset an incremental verifier, to be fed with the image from its first byte
+ *
+ * @retval kStatus_Success: all OK
+ *         otherwise something failed
+ */
+status_t bl_verify_init(bl_verify_ctx_t *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    mbedtls_sha256_init(&ctx->sha);
+    if (mbedtls_sha256_starts_ret(&ctx->sha, 0) != 0)
+        ctx->status = kStatus_Fail;
+
+    return ctx->status;
+}
+
+/* Called each time the verifier completes one of the image areas it tracks */
+static status_t bl_verify_area_complete(bl_verify_ctx_t *ctx, uint32_t pos)
+{
+    struct image_header *ih = &ctx->hdr;
+    struct image_tlv_info it;
+
+    if (pos == sizeof(struct image_header))
+    {
+        if (ih->ih_magic != IMAGE_MAGIC)
+        {
+            LogError(("Image validation failed with magic=0x%X != 0x%X", (int)ih->ih_magic, IMAGE_MAGIC));
+            return kStatus_Fail;
+        }
+        if (ih->ih_hdr_size < sizeof(struct image_header) ||
+            (ih->ih_protect_tlv_size > 0 && ih->ih_protect_tlv_size < sizeof(struct image_tlv_info)))
+        {
+            LogError(("Image validation failed, inconsistent header sizes"));
+            return kStatus_Fail;
+        }
+        ctx->hash_size = ih->ih_hdr_size + ih->ih_img_size + ih->ih_protect_tlv_size;
+    }
+    else if (ih->ih_protect_tlv_size > 0 && pos == ih->ih_hdr_size + ih->ih_img_size + sizeof(struct image_tlv_info))
+    {
+        if ((ctx->prot_info.it_magic != IMAGE_TLV_PROT_INFO_MAGIC) ||
+            (ctx->prot_info.it_tlv_tot != ih->ih_protect_tlv_size))
+        {
+            LogError(("Image validation failed, bad protected TLV info 0x%X (%u)", ctx->prot_info.it_magic,
+                      ctx->prot_info.it_tlv_tot));
+            return kStatus_Fail;
+        }
+    }
+    else if (pos == ctx->hash_size + sizeof(struct image_tlv_info))
+    {
+        memcpy(&it, ctx->tlv, sizeof(it));
+        if (it.it_magic != IMAGE_TLV_INFO_MAGIC)
+        {
+            LogError(("Image validation failed (it->it_magic != IMAGE_TLV_INFO_MAGIC) 0x%X 0x%X", it.it_magic,
+                      IMAGE_TLV_INFO_MAGIC));
+            return kStatus_Fail;
+        }
+        if (it.it_tlv_tot < sizeof(struct image_tlv_info) || it.it_tlv_tot > sizeof(ctx->tlv))
+        {
+            LogError(("Image validation failed, unsupported TLV area size %u", it.it_tlv_tot));
+            return kStatus_Fail;
+        }
+        ctx->tlv_size = it.it_tlv_tot;
+    }
+
+    return kStatus_Success;
+}
+
+/** Feed the next chunk of the image to an incremental verifier.
+ *  Header, body and protected TLVs are hashed on the fly, the unprotected TLV
+ *  area is kept in the context and anything past it (padding) is ignored.
+ *
+ * @retval kStatus_Success: all OK so far
+ *         otherwise the image is invalid
+ */
+status_t bl_verify_update(bl_verify_ctx_t *ctx, const uint8_t *data, uint32_t len)
+{
+    while (ctx->status == kStatus_Success && len > 0)
+    {
+        uint32_t pos      = ctx->received;
+        uint32_t prot_off = ctx->hdr.ih_hdr_size + ctx->hdr.ih_img_size;
+        uint32_t end;
+        uint32_t n;
+
+        if (pos < sizeof(struct image_header))
+            end = sizeof(struct image_header);
+        else if (pos < prot_off)
+            end = prot_off;
+        else if (pos < prot_off + sizeof(struct image_tlv_info) && ctx->hdr.ih_protect_tlv_size > 0)
+            end = prot_off + sizeof(struct image_tlv_info);
+        else if (pos < ctx->hash_size)
+            end = ctx->hash_size;
+        else if (pos < ctx->hash_size + sizeof(struct image_tlv_info))
+            end = ctx->hash_size + sizeof(struct image_tlv_info);
+        else if (pos < ctx->hash_size + ctx->tlv_size)
+            end = ctx->hash_size + ctx->tlv_size;
+        else
+        {
+            ctx->received += len;
+            break;
+        }
+
+        n = (len > end - pos) ? end - pos : len;
+
+        if (pos < ctx->hash_size || pos < sizeof(struct image_header))
+        {
+            if (pos < sizeof(struct image_header))
+                memcpy((uint8_t *)&ctx->hdr + pos, data, n);
+            else if (pos >= prot_off && end == prot_off + sizeof(struct image_tlv_info))
+                memcpy((uint8_t *)&ctx->prot_info + (pos - prot_off), data, n);
+            if (mbedtls_sha256_update_ret(&ctx->sha, data, n) != 0)
+                ctx->status = kStatus_Fail;
+        }
+        else
+        {
+            memcpy(ctx->tlv + (pos - ctx->hash_size), data, n);
+        }
+
+        ctx->received += n;
+        data += n;
+        len -= n;
+
+        if (ctx->status == kStatus_Success && ctx->received == end)
+            ctx->status = bl_verify_area_complete(ctx, end);
+    }
+
+    return ctx->status;
+}
+
+/** Complete the verification once the whole image was fed to the verifier
+ *
+ * @retval kStatus_Success: image is complete, its SHA256 TLV matches and,
+ *                          with AKNANO_IMAGE_SIGNATURE, it is signed with the embedded key
+ *         otherwise the image is invalid
+ */
+status_t bl_verify_finish(bl_verify_ctx_t *ctx)
+{
+    uint8_t computed_hash[BL_SHA256_DIGEST_SIZE];
+    const uint8_t *expected_hash;
+    bl_tlv_index_t index;
+    status_t status = ctx->status;
+
+    if (status == kStatus_Success && (ctx->tlv_size == 0 || ctx->received < ctx->hash_size + ctx->tlv_size))
+    {
+        LogError(("Image validation failed, image is truncated (%lu bytes)", ctx->received));
+        status = kStatus_Fail;
+    }
+
+    if (status == kStatus_Success && mbedtls_sha256_finish_ret(&ctx->sha, computed_hash) != 0)
+        status = kStatus_Fail;
+
+    if (status == kStatus_Success)
+    {
+        expected_hash = NULL;
+        if (bl_tlv_index_build(&index, ctx->tlv, ctx->tlv_size) == kStatus_Success)
+            expected_hash = bl_tlv_find(&index, ctx->tlv, kBlTlv_Sha256, BL_SHA256_DIGEST_SIZE);
+        if (expected_hash == NULL)
+        {
+            LogError(("Image validation failed, no SHA256 TLV found"));
+            status = kStatus_Fail;
+        }
+        else if (memcmp(expected_hash, computed_hash, BL_SHA256_DIGEST_SIZE) != 0)
+        {
+            LogError(("Image validation failed, SHA256 mismatch"));
+            status = kStatus_Fail;
+        }
+#ifdef AKNANO_IMAGE_SIGNATURE
+        else
+            status = image_signature_verify(&index, ctx->tlv, computed_hash);
+#endif
+    }
+
+    mbedtls_sha256_free(&ctx->sha);
+    ctx->status = (status == kStatus_Success) ? kStatus_Success : kStatus_Fail;
+    return ctx->status;
+}
+
+/** Record that the image at the given physical offset was verified while being
+ *  written, so that bl_verify_image() does not need to read it back.
+ *  A size of 0 forgets any previous record.
+ */
+void bl_verify_mark_verified(uint32_t offset, uint32_t size)
+{
+    verified_image.start = offset;
+    verified_image.size  = size;
+}
+
+int32_t bl_verify_image(const uint8_t *data, uint32_t size)
+{
+    struct image_header *ih = &image_tlvs.hdr;
+    const uint32_t offset   = (uint32_t)data;
+    const uint8_t *expected_hash;
+    uint8_t computed_hash[BL_SHA256_DIGEST_SIZE];
+    status_t status;
+
+    if (verified_image.size != 0 && verified_image.start == offset && verified_image.size == size)
+    {
+        LogInfo(("Image was verified while being written, skipping read back"));
+        return 1;
+    }
+
+    /* end of a download done without slot_writer, which drops the cache itself */
+    bl_drop_image_cache();
+
+    status = bl_read_image_tlvs(offset, size, &image_tlvs);
+    if (status == kStatus_NoData && size >= sizeof(struct image_header))
+        LogError(("Image validation failed with magic=0x%X != 0x%X", (int)ih->ih_magic, IMAGE_MAGIC));
+    if (status != kStatus_Success)
+        return 0;
+
+    expected_hash = bl_image_tlv(&image_tlvs, kBlTlv_Sha256, BL_SHA256_DIGEST_SIZE);
+    if (expected_hash == NULL)
+    {
+        LogError(("Image validation failed, no SHA256 TLV found"));
         return 0;
     }
-    it = (struct image_tlv_info *)buffer;
-    if ((it->it_magic != IMAGE_TLV_INFO_MAGIC))
+
+    if (bl_hash_flash(offset, ih->ih_hdr_size + ih->ih_img_size + ih->ih_protect_tlv_size, computed_hash) !=
+        kStatus_Success)
+    {
+        LogError(("Image validation failed, unable to hash image"));
+        return 0;
+    }
+
+    if (memcmp(expected_hash, computed_hash, BL_SHA256_DIGEST_SIZE) != 0)
     {
-        LogError(("Image validation failed (it->it_magic != IMAGE_TLV_INFO_MAGIC) 0x%X 0x%X", it->it_magic, IMAGE_TLV_INFO_MAGIC));
+        LogError(("Image validation failed, SHA256 mismatch"));
         return 0;
     }
 
+#ifdef AKNANO_IMAGE_SIGNATURE
+    /* catch images the bootloader would reject before asking it to swap */
+    if (image_signature_verify(&image_tlvs.index, (const uint8_t *)image_tlvs.tlv + image_tlvs.unprot_off,
+                               computed_hash) != kStatus_Success)
+        return 0;
+#endif
+
     return 1;
 }
 
+/** Read the SHA256 digest recorded in the TLVs of the image at the given
+ *  physical offset. The image itself is not hashed.
+ *
+ * @retval kStatus_Success: digest holds the SHA256 TLV value
+ *         kStatus_NoData: no valid image or no SHA256 TLV
+ *         otherwise flash read failed
+ */
+status_t bl_get_image_digest(uint32_t offset, uint8_t digest[BL_SHA256_DIGEST_SIZE])
+{
+    const uint8_t *value;
+    bl_image_info_t info;
+    status_t status;
+    uint32_t i;
+
+    /* images of the application slots are known to bl_get_image_info() */
+    for (i = 0; i < 2; i++)
+    {
+        if (partition_slot(0, i)->offset != offset)
+            continue;
+
+        status = bl_get_image_info(0, i, &info);
+        if (status != kStatus_Success)
+            return status;
+        if (!info.has_digest)
+            return kStatus_NoData;
+
+        memcpy(digest, info.digest, BL_SHA256_DIGEST_SIZE);
+        return kStatus_Success;
+    }
+
+    status = bl_read_image_tlvs(offset, partition_slot(0, PARTITION_SLOT_PRIMARY)->size, &image_tlvs);
+    if (status != kStatus_Success)
+        return status;
+
+    value = bl_image_tlv(&image_tlvs, kBlTlv_Sha256, BL_SHA256_DIGEST_SIZE);
+    if (value == NULL)
+        return kStatus_NoData;
+
+    memcpy(digest, value, BL_SHA256_DIGEST_SIZE);
+    return kStatus_Success;
+}
+
 /** Find out the destination slot (partition) for storage OTA image
  *
  * @param ptn partition_t struct for storing destination OTA image
@@ -469,6 +963,7 @@ int32_t bl_verify_image(const uint8_t *data, uint32_t size)
  */
 status_t bl_get_update_partition_info(partition_t *ptn)
 {
+    const partition_entry_t *slot;
     uint32_t state;
     status_t ret;
 
@@ -483,16 +978,17 @@ status_t bl_get_update_partition_info(partition_t *ptn)
         goto error;
     }
 
-    if (get_active_image() == PRIMARY_SLOT_ACTIVE)
-    {
-        ptn->start = BOOT_FLASH_CAND_APP - BOOT_FLASH_BASE;
-        ptn->size  = BOOT_FLASH_CAND_APP - BOOT_FLASH_ACT_APP;
-    }
-    else
-    {
-        ptn->start = BOOT_FLASH_ACT_APP - BOOT_FLASH_BASE;
-        ptn->size  = BOOT_FLASH_CAND_APP - BOOT_FLASH_ACT_APP;
-    }
+    slot       = partition_slot(0, bl_other_slot());
+    ptn->start = slot->offset;
+    ptn->size  = slot->size;
+
+    /* the slot is about to be written, maybe not through slot_writer: what
+     * was verified in it does not hold any more. The cached header is dropped
+     * by bl_verify_image() once the image is written. */
+    bl_verify_mark_verified(0, 0);
+
+    /* an interrupted download into the other slot cannot be resumed any more */
+    dl_progress_check_slot(ptn->start);
 
     return kStatus_Success;
 error:
@@ -511,6 +1007,12 @@ status_t bl_update_image_state(uint32_t state)
 
         case kSwapType_Permanent:
             status = boot_swap_ok();
+            /* the previous image is not needed any more, get its slot ready for the next update */
+            if (status == kStatus_Success)
+            {
+                erase_ahead_request_slot_erase();
+                update_txn_app_confirmed();
+            }
             break;
 
         default:
@@ -518,50 +1020,38 @@ status_t bl_update_image_state(uint32_t state)
             break;
     }
 
+    /* the trailer sector was just rewritten, keep the counters before the caller reboots */
+    if (status == kStatus_Success)
+    {
+        status_t wear_status = flash_wear_flush();
+
+        if (wear_status != kStatus_Success && wear_status != kStatus_NoData)
+            LogWarn(("Flash wear log not updated: %d", wear_status));
+    }
+
     return status;
 }
 
-status_t bl_get_image_state(uint32_t *state)
+/* Derive the swap state from the trailers of both slots */
+static uint32_t bl_swap_state_from_trailers(struct image_trailer *image_trailer1, struct image_trailer *image_trailer2)
 {
-    status_t status;
-    uint32_t off;
-
-    struct image_trailer image_trailer1;
-    struct image_trailer image_trailer2;
-
     struct image_trailer *image_trailer_active;
 #ifndef CONFIG_MCUBOOT_FLASH_REMAP_ENABLE
     struct image_trailer *image_trailer_dormant;
 #endif
 
-    off    = FLASH_AREA_IMAGE_1_OFFSET + FLASH_AREA_IMAGE_1_SIZE - sizeof(struct image_trailer);
-    status = flash_read(off, (uint32_t *)&image_trailer1, sizeof(struct image_trailer));
-    if (status)
-    {
-        LogError(("%s: failed to read trailer in primary slot", __func__));
-        return status;
-    }
-
-    off    = FLASH_AREA_IMAGE_2_OFFSET + FLASH_AREA_IMAGE_2_SIZE - sizeof(struct image_trailer);
-    status = flash_read(off, (uint32_t *)&image_trailer2, sizeof(struct image_trailer));
-    if (status)
-    {
-        LogError(("%s: failed to read trailer in secondary slot", __func__));
-        return status;
-    }
-
     if (get_active_image() == PRIMARY_SLOT_ACTIVE)
     {
-        image_trailer_active  = &image_trailer1;
+        image_trailer_active  = image_trailer1;
 #ifndef CONFIG_MCUBOOT_FLASH_REMAP_ENABLE
-        image_trailer_dormant = &image_trailer2;
+        image_trailer_dormant = image_trailer2;
 #endif
     }
     else
     {
-        image_trailer_active  = &image_trailer2;
+        image_trailer_active  = image_trailer2;
 #ifndef CONFIG_MCUBOOT_FLASH_REMAP_ENABLE
-        image_trailer_dormant = &image_trailer1;
+        image_trailer_dormant = image_trailer1;
 #endif
     }
 
@@ -571,14 +1061,12 @@ status_t bl_get_image_state(uint32_t *state)
         if (check_unset(&image_trailer_dormant->image_ok, sizeof(image_trailer_dormant->image_ok)))
         {
             /* State I (request for swaping upon next reboot) */
-            *state = kSwapType_ReadyForTest;
-            return kStatus_Success;
+            return kSwapType_ReadyForTest;
         }
         else if (image_trailer_dormant->image_ok == 0x01)
         {
             /* State II (image marked for permanent change) */
-            *state = kSwapType_Permanent;
-            return kStatus_Success;
+            return kSwapType_Permanent;
         }
     }
     else if (check_unset(image_trailer_dormant->magic, sizeof(image_trailer_dormant->magic)))
@@ -588,19 +1076,158 @@ status_t bl_get_image_state(uint32_t *state)
             (image_trailer_active->copy_done == 0x01))
         {
             /* State III (revert scheduled for next reboot => image is under test) */
-            *state = kSwapType_Testing;
-            return kStatus_Success;
+            return kSwapType_Testing;
         }
     }
 
     /* State IV (none of the above) */
-    *state = kSwapType_None;
+    return kSwapType_None;
+}
+
+/* Fill the image state cache from flash, if not already done */
+static status_t bl_load_image_state(void)
+{
+    const partition_entry_t *slot;
+    status_t status;
+    uint32_t off;
+    int i;
+
+    if (image_state_valid)
+        return kStatus_Success;
+
+    for (i = 0; i < 2; i++)
+    {
+        slot   = partition_slot(0, i);
+        off    = slot->offset + slot->size - sizeof(struct image_trailer);
+        status = flash_read(off, (uint32_t *)&image_state.trailer[i], sizeof(struct image_trailer));
+        if (status)
+        {
+            LogError(("%s: failed to read trailer in %s slot", __func__, i == 0 ? "primary" : "secondary"));
+            return status;
+        }
+
+        status = flash_read(slot->offset, (uint32_t *)&image_state.header[i], sizeof(struct image_header));
+        if (status)
+        {
+            LogError(("%s: failed to read header in %s slot", __func__, i == 0 ? "primary" : "secondary"));
+            return status;
+        }
+    }
+
+    image_state.active_slot = get_active_image();
+    image_state.swap_state  = bl_swap_state_from_trailers(&image_state.trailer[0], &image_state.trailer[1]);
+    image_state_valid       = true;
+
     return kStatus_Success;
 }
 
+/** Drop the cached image state, so that it is read again from flash on next use.
+ *  Needed whenever a trailer or an image header is modified. An image recorded
+ *  by bl_verify_mark_verified() is verified from flash again as well.
+ */
+void bl_invalidate_image_state(void)
+{
+    bl_verify_mark_verified(0, 0);
+    bl_drop_image_cache();
+}
+
+/** Get the cached state of both slots: active slot, swap state, trailers and headers.
+ *  Flash is only read on the first call after boot or after an invalidation.
+ *
+ * @retval kStatus_Success: info is valid
+ *         otherwise flash read failed
+ */
+status_t bl_get_image_state_info(bl_image_state_t *info)
+{
+    status_t status = bl_load_image_state();
+
+    if (status == kStatus_Success)
+        memcpy(info, &image_state, sizeof(*info));
+
+    return status;
+}
+
+status_t bl_get_image_state(uint32_t *state)
+{
+    status_t status = bl_load_image_state();
+
+    if (status == kStatus_Success)
+        *state = image_state.swap_state;
+
+    return status;
+}
+
+/** Get the build number of the running image (image_position 1) or of the
+ *  image in the secondary slot (image_position 2), from the cached headers.
+ *  bl_get_image_info() has the rest of the metadata.
+ */
 status_t bl_get_image_build_num(uint32_t *iv_build_num, uint8_t image_position)
 {
-    struct image_header *ih = image_position == 2? (void*)BOOT_FLASH_CAND_APP : (void*)BOOT_FLASH_ACT_APP;
-    *iv_build_num = ih->ih_ver.iv_build_num;
+    status_t status = bl_load_image_state();
+    uint32_t slot;
+
+    if (status != kStatus_Success)
+        return status;
+
+    /* with flash remapping, the active slot is what shows at BOOT_FLASH_ACT_APP */
+    if (image_position == 2)
+        slot = PARTITION_SLOT_SECONDARY;
+    else
+        slot = image_state.active_slot == SECONDARY_SLOT_ACTIVE ? PARTITION_SLOT_SECONDARY : PARTITION_SLOT_PRIMARY;
+
+    *iv_build_num = image_state.header[slot].ih_ver.iv_build_num;
+    return kStatus_Success;
+}
+
+/** Get the metadata of the image in a slot: version, flags, size and SHA256
+ *  TLV digest. Flash is only read on the first call for the slot after boot
+ *  or after the slot was written (see bl_invalidate_image_state()).
+ *
+ * @param image image number, 0 being the application
+ * @param slot PARTITION_SLOT_[...], physical slot and not the active one
+ *
+ * @retval kStatus_Success: info is valid, info->present telling if there is an image
+ *         kStatus_InvalidArgument: no such slot in the partition table
+ *         otherwise the image is malformed or flash read failed, nothing is cached
+ */
+status_t bl_get_image_info(uint32_t image, uint32_t slot, bl_image_info_t *info)
+{
+    const partition_entry_t *ptn = image < PARTITION_MAX_IDS ? partition_slot(image, slot) : NULL;
+    bl_image_info_t *cached;
+    const uint8_t *value;
+    status_t status;
+
+    if (ptn == NULL)
+        return kStatus_InvalidArgument;
+
+    cached = &image_info[image][slot];
+    if (!image_info_valid[image][slot])
+    {
+        memset(cached, 0, sizeof(*cached));
+
+        status = bl_read_image_tlvs(ptn->offset, ptn->size, &image_tlvs);
+        if (status == kStatus_Success)
+        {
+            cached->present  = true;
+            cached->ih_ver   = image_tlvs.hdr.ih_ver;
+            cached->ih_flags = image_tlvs.hdr.ih_flags;
+            cached->size     = image_tlvs.hdr.ih_hdr_size + image_tlvs.hdr.ih_img_size + image_tlvs.tlv_size;
+
+            value = bl_image_tlv(&image_tlvs, kBlTlv_Sha256, BL_SHA256_DIGEST_SIZE);
+            if (value != NULL)
+            {
+                memcpy(cached->digest, value, BL_SHA256_DIGEST_SIZE);
+                cached->has_digest = true;
+            }
+        }
+        else if (status != kStatus_NoData)
+        {
+            return status;
+        }
+
+        image_info_valid[image][slot] = true;
+    }
+
+    memcpy(info, cached, sizeof(*info));
     return kStatus_Success;
 }
@@ -11,9 +11,14 @@
 
 #define CONFIG_MCUBOOT_FLASH_REMAP_ENABLE
 
+/* Update trailers by programming over erased bytes when possible, instead of
+ * erasing the trailer sector on every state change */
+#define CONFIG_MCUBOOT_TRAILER_JOURNAL
+
 #include "fsl_common.h"
 #include "flash_partitioning.h"
 #include "image.h"
+#include "mbedtls/sha256.h"
 
 #define FLASH_AREA_IMAGE_1_OFFSET (BOOT_FLASH_ACT_APP - BOOT_FLASH_BASE)
 #define FLASH_AREA_IMAGE_1_SIZE   (BOOT_FLASH_CAND_APP - BOOT_FLASH_ACT_APP)
@@ -29,6 +34,9 @@
 #define IMAGE_TLV_PROT_INFO_MAGIC 0x6908
 
 
+#define PRIMARY_SLOT_ACTIVE   0
+#define SECONDARY_SLOT_ACTIVE 1
+
 #define BOOT_MAX_ALIGN 8
 #define BOOT_FLAG_SET  1
 
@@ -43,6 +51,9 @@ struct image_trailer
     uint8_t magic[16];
 };
 
+/* Trailer magic, as written by MCUboot */
+extern const uint32_t boot_img_magic[4];
+
 /* Bootloader helper API */
 enum
 {
@@ -61,14 +72,101 @@ typedef struct
     uint32_t size;
 } partition_t;
 
+/* Cached state of both slots, index 0 is the primary slot and 1 the secondary one */
+typedef struct
+{
+    uint32_t active_slot; /* as returned by get_active_image() */
+    uint32_t swap_state;  /* kSwapType_[...] */
+    struct image_trailer trailer[2];
+    struct image_header header[2];
+} bl_image_state_t;
+
+#define BL_SHA256_DIGEST_SIZE 32
+
+/* Largest unprotected TLV area that can be checked while streaming */
+#define BL_VERIFY_TLV_MAX_SIZE 1024
+
+/* Largest protected and unprotected TLV areas, read at once from flash */
+#define BL_IMAGE_TLV_MAX_SIZE 1024
+
+/* TLVs located by bl_tlv_index_build() */
+enum
+{
+    kBlTlv_KeyHash,    /* IMAGE_TLV_KEYHASH */
+    kBlTlv_Sha256,     /* IMAGE_TLV_SHA256 */
+    kBlTlv_Rsa2048Pss, /* IMAGE_TLV_RSA2048_PSS */
+    kBlTlv_Ecdsa256,   /* IMAGE_TLV_ECDSA256 */
+    kBlTlv_EncRsa2048, /* IMAGE_TLV_ENC_RSA2048 */
+    kBlTlv_EncKw128,   /* IMAGE_TLV_ENC_KW128 */
+    kBlTlv_Max,
+};
+
+/* Index of an unprotected TLV area, built in a single walk */
+typedef struct
+{
+    uint16_t off[kBlTlv_Max]; /* offset of the value in the area, 0 when absent */
+    uint16_t len[kBlTlv_Max];
+} bl_tlv_index_t;
+
+/* Header and TLV areas of an image in flash */
+typedef struct
+{
+    struct image_header hdr;
+    uint32_t tlv_size;   /* protected + unprotected TLV area size */
+    uint32_t unprot_off; /* offset of the unprotected area in tlv */
+    bl_tlv_index_t index;
+    uint32_t tlv[BL_IMAGE_TLV_MAX_SIZE / sizeof(uint32_t)];
+} bl_image_tlvs_t;
+
+/* Metadata of the image in a slot, as returned by bl_get_image_info() */
+typedef struct
+{
+    bool present;                /* false when the slot holds no image, the fields below are then 0 */
+    bool has_digest;             /* digest is valid */
+    struct image_version ih_ver; /* full version from the image header */
+    uint32_t ih_flags;           /* IMAGE_F_[...] */
+    uint32_t size;               /* header + body + TLV areas */
+    uint8_t digest[BL_SHA256_DIGEST_SIZE]; /* IMAGE_TLV_SHA256 value */
+} bl_image_info_t;
+
+/* Incremental image verifier, fed with the image as it is written to flash */
+typedef struct
+{
+    mbedtls_sha256_context sha;
+    struct image_header hdr;
+    struct image_tlv_info prot_info;
+    uint32_t received;  /* number of image bytes fed so far */
+    uint32_t hash_size; /* header + body + protected TLVs, known once the header is complete */
+    uint32_t tlv_size;  /* unprotected TLV area size, known once its image_tlv_info is complete */
+    status_t status;
+    uint8_t tlv[BL_VERIFY_TLV_MAX_SIZE];
+} bl_verify_ctx_t;
+
 
 extern int32_t bl_verify_image(const uint8_t *data, uint32_t size);
 
+extern status_t bl_verify_init(bl_verify_ctx_t *ctx);
+extern status_t bl_verify_update(bl_verify_ctx_t *ctx, const uint8_t *data, uint32_t len);
+extern status_t bl_verify_finish(bl_verify_ctx_t *ctx);
+extern void bl_verify_mark_verified(uint32_t offset, uint32_t size);
+extern status_t bl_get_image_digest(uint32_t offset, uint8_t digest[BL_SHA256_DIGEST_SIZE]);
+
+extern status_t bl_tlv_index_build(bl_tlv_index_t *index, const uint8_t *area, uint32_t size);
+extern const uint8_t *bl_tlv_find(const bl_tlv_index_t *index, const uint8_t *area, uint32_t tlv, uint16_t len);
+extern status_t bl_read_image_tlvs(uint32_t offset, uint32_t size, bl_image_tlvs_t *img);
+extern const uint8_t *bl_image_tlv(const bl_image_tlvs_t *img, uint32_t tlv, uint16_t len);
+
 extern status_t bl_get_update_partition_info(partition_t *ptn);
 extern status_t bl_update_image_state(uint32_t state);
 extern status_t bl_get_image_state(uint32_t *state);
+extern status_t bl_get_image_state_info(bl_image_state_t *info);
+extern void bl_invalidate_image_state(void);
 
 status_t bl_get_image_build_num(uint32_t *iv_build_num, uint8_t image_position);
+status_t bl_get_image_info(uint32_t image, uint32_t slot, bl_image_info_t *info);
+
+int32_t bl_flash_read(uint32_t addr, void *buffer, uint32_t len);
+uint32_t bl_crc32(const void *data, uint32_t len);
 
 uint32_t get_active_image(void);
 
@@ -0,0 +1,188 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "logging_levels.h"
+#define LIBRARY_LOG_NAME "partition_table"
+#define LIBRARY_LOG_LEVEL LOG_INFO
+#include "logging_stack.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "partition_table.h"
+#include "mcuboot_app_support.h"
+#include "mflash_drv.h"
+
+#define PARTITION_TABLE_OFFSET (BOOT_FLASH_PARTITION_TABLE - BOOT_FLASH_BASE)
+
+/* Layout used when there is no table in flash */
+static const partition_table_t default_table = {
+    .magic   = PARTITION_TABLE_MAGIC,
+    .version = PARTITION_TABLE_VERSION,
+    .count   = 5,
+    .entry =
+        {
+            {kPartitionType_Slot, 0, PARTITION_SLOT_PRIMARY, 0xff, FLASH_AREA_IMAGE_1_OFFSET, FLASH_AREA_IMAGE_1_SIZE},
+            {kPartitionType_Slot, 0, PARTITION_SLOT_SECONDARY, 0xff, FLASH_AREA_IMAGE_2_OFFSET,
+             FLASH_AREA_IMAGE_2_SIZE},
+            {kPartitionType_Storage, kPartitionStorage_DlProgress, 0, 0xff, BOOT_FLASH_DL_PROGRESS - BOOT_FLASH_BASE,
+             BOOT_FLASH_DL_PROGRESS_SIZE},
+            {kPartitionType_Storage, kPartitionStorage_UpdateTxn, 0, 0xff, BOOT_FLASH_UPDATE_TXN - BOOT_FLASH_BASE,
+             BOOT_FLASH_UPDATE_TXN_SIZE},
+            {kPartitionType_Storage, kPartitionStorage_WearLog, 0, 0xff, BOOT_FLASH_WEAR_LOG - BOOT_FLASH_BASE,
+             BOOT_FLASH_WEAR_LOG_SIZE},
+        },
+};
+
+static partition_table_t table;
+static bool table_loaded;
+static bool table_from_flash;
+
+/* Entry index + 1 for each type, id and slot, 0 when absent */
+static uint8_t lookup[kPartitionType_Max][PARTITION_MAX_IDS][2];
+
+static bool partition_overlap(const partition_entry_t *a, uint32_t offset, uint32_t size)
+{
+    return a->offset < offset + size && offset < a->offset + a->size;
+}
+
+/* Check a table and build its lookup index */
+static bool partition_table_index(const partition_table_t *t)
+{
+    const partition_entry_t *e;
+    const partition_entry_t *other;
+    uint32_t i;
+    uint32_t j;
+
+    memset(lookup, 0, sizeof(lookup));
+
+    if (t->magic != PARTITION_TABLE_MAGIC || t->version != PARTITION_TABLE_VERSION || t->count == 0 ||
+        t->count > PARTITION_TABLE_MAX_ENTRIES || t->crc != bl_crc32(t, offsetof(partition_table_t, crc)))
+        return false;
+
+    for (i = 0; i < t->count; i++)
+    {
+        e = &t->entry[i];
+
+        if (e->type >= kPartitionType_Max || e->id >= PARTITION_MAX_IDS || e->slot > PARTITION_SLOT_SECONDARY ||
+            (e->type != kPartitionType_Slot && e->slot != 0) || e->size == 0 ||
+            e->offset % MFLASH_SECTOR_SIZE != 0 || e->size % MFLASH_SECTOR_SIZE != 0 || e->offset + e->size < e->offset)
+        {
+            LogError(("Invalid partition table entry %lu", i));
+            return false;
+        }
+
+        if (lookup[e->type][e->id][e->slot] != 0 ||
+            partition_overlap(e, PARTITION_TABLE_OFFSET, BOOT_FLASH_PARTITION_TABLE_SIZE))
+        {
+            LogError(("Partition table entry %lu is a duplicate or overlaps the table", i));
+            return false;
+        }
+
+        for (j = 0; j < i; j++)
+        {
+            if (partition_overlap(&t->entry[j], e->offset, e->size))
+            {
+                LogError(("Partition table entries %lu and %lu overlap", j, i));
+                return false;
+            }
+        }
+
+        lookup[e->type][e->id][e->slot] = i + 1;
+    }
+
+    /* slots go by pairs of the same size, and the application has some */
+    for (i = 0; i < PARTITION_MAX_IDS; i++)
+    {
+        e     = lookup[kPartitionType_Slot][i][0] ? &t->entry[lookup[kPartitionType_Slot][i][0] - 1] : NULL;
+        other = lookup[kPartitionType_Slot][i][1] ? &t->entry[lookup[kPartitionType_Slot][i][1] - 1] : NULL;
+
+        if ((e == NULL && (i == 0 || other != NULL)) || (e != NULL && (other == NULL || e->size != other->size)))
+        {
+            LogError(("Partition table slots of image %lu do not make a pair", i));
+            return false;
+        }
+    }
+
+    if (lookup[kPartitionType_Storage][kPartitionStorage_DlProgress][0] == 0)
+    {
+        LogError(("Partition table has no download progress area"));
+        return false;
+    }
+
+    return true;
+}
+
+/** Read the partition table from flash, falling back to the built-in layout.
+ *  Done once, on first use of the table.
+ *
+ * @retval kStatus_Success: the table read from flash is used
+ *         kStatus_NoData: the built-in layout is used
+ */
+status_t partition_table_load(void)
+{
+    if (table_loaded)
+        return table_from_flash ? kStatus_Success : kStatus_NoData;
+
+    table_loaded = true;
+
+    if (bl_flash_read(PARTITION_TABLE_OFFSET, &table, sizeof(table)) == 0 && table.magic != 0xffffffff)
+    {
+        if (partition_table_index(&table))
+        {
+            LogInfo(("Using partition table at 0x%X, %u entries", PARTITION_TABLE_OFFSET, table.count));
+            table_from_flash = true;
+            return kStatus_Success;
+        }
+        LogError(("Invalid partition table at 0x%X, using the built-in layout", PARTITION_TABLE_OFFSET));
+    }
+
+    memcpy(&table, &default_table, sizeof(table));
+    table.crc = bl_crc32(&table, offsetof(partition_table_t, crc));
+    partition_table_index(&table);
+    return kStatus_NoData;
+}
+
+/** Get the partition table in use */
+const partition_table_t *partition_table_get(void)
+{
+    if (!table_loaded)
+        partition_table_load();
+
+    return &table;
+}
+
+/** Find a partition, in constant time
+ *
+ * @param type kPartitionType_[...]
+ * @param id image number or area id
+ * @param slot PARTITION_SLOT_[...] for slots, 0 otherwise
+ *
+ * @retval the partition, or NULL if there is none
+ */
+const partition_entry_t *partition_get(uint32_t type, uint32_t id, uint32_t slot)
+{
+    uint8_t idx;
+
+    if (!table_loaded)
+        partition_table_load();
+
+    if (type >= kPartitionType_Max || id >= PARTITION_MAX_IDS || slot > PARTITION_SLOT_SECONDARY)
+        return NULL;
+
+    idx = lookup[type][id][slot];
+    return idx ? &table.entry[idx - 1] : NULL;
+}
+
+/** Find a slot of an image. The slots of image 0, the application, always exist.
+ *
+ * @retval the slot, or NULL if the image has none
+ */
+const partition_entry_t *partition_slot(uint32_t image, uint32_t slot)
+{
+    return partition_get(kPartitionType_Slot, image, slot);
+}
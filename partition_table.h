@@ -0,0 +1,72 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef __PARTITION_TABLE_H__
+#define __PARTITION_TABLE_H__
+
+#include "fsl_common.h"
+
+/*
+ * Flash layout used by the application: image slots, scratch and storage
+ * areas, and data partitions.
+ *
+ * The table is read once from the BOOT_FLASH_PARTITION_TABLE sector. When that
+ * sector holds no valid table, the layout of flash_partitioning.h is used.
+ * Slots must match the layout the bootloader was built with.
+ */
+#define PARTITION_TABLE_MAGIC       0x54504b41 /* "AKPT" */
+#define PARTITION_TABLE_VERSION     1
+#define PARTITION_TABLE_MAX_ENTRIES 16
+
+/* Highest image number / area id + 1 */
+#define PARTITION_MAX_IDS 4
+
+enum
+{
+    kPartitionType_Slot,    /* id is the image number, 0 being the application */
+    kPartitionType_Scratch, /* swap scratch area */
+    kPartitionType_Storage, /* records kept by this application, id is kPartitionStorage_[...] */
+    kPartitionType_Data,    /* raw data, id is up to the application */
+    kPartitionType_Max,
+};
+
+enum
+{
+    kPartitionStorage_DlProgress, /* download progress record, see download_progress.c */
+    kPartitionStorage_UpdateTxn,  /* update transaction record, see update_txn.c */
+    kPartitionStorage_WearLog,    /* flash wear counters, see flash_wear.c */
+};
+
+#define PARTITION_SLOT_PRIMARY   0
+#define PARTITION_SLOT_SECONDARY 1
+
+typedef struct
+{
+    uint8_t type;    /* kPartitionType_[...] */
+    uint8_t id;      /* image number or area id, < PARTITION_MAX_IDS */
+    uint8_t slot;    /* PARTITION_SLOT_[...] for slots, 0 otherwise */
+    uint8_t flags;   /* reserved, 0xff */
+    uint32_t offset; /* physical offset, sector aligned */
+    uint32_t size;   /* multiple of the sector size */
+} partition_entry_t;
+
+/* As stored in flash */
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+    partition_entry_t entry[PARTITION_TABLE_MAX_ENTRIES];
+    uint32_t crc; /* CRC32 of the fields above */
+} partition_table_t;
+
+status_t partition_table_load(void);
+const partition_table_t *partition_table_get(void);
+const partition_entry_t *partition_get(uint32_t type, uint32_t id, uint32_t slot);
+const partition_entry_t *partition_slot(uint32_t image, uint32_t slot);
+
+#endif
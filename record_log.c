@@ -0,0 +1,134 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "logging_levels.h"
+#define LIBRARY_LOG_NAME "record_log"
+#define LIBRARY_LOG_LEVEL LOG_INFO
+#include "logging_stack.h"
+
+#include <string.h>
+
+#include "record_log.h"
+#include "mcuboot_app_support.h"
+#include "flexspi_flash_config.h"
+
+#define SECTOR_PAGES (MFLASH_SECTOR_SIZE / MFLASH_PAGE_SIZE)
+
+/* The CRC32 is the last word of the record */
+static uint32_t record_log_crc(const record_log_t *log, const void *record)
+{
+    return bl_crc32(record, log->size - sizeof(uint32_t));
+}
+
+static bool record_log_valid(const record_log_t *log, const void *record)
+{
+    const record_log_hdr_t *hdr = record;
+    uint32_t crc;
+
+    memcpy(&crc, (const uint8_t *)record + log->size - sizeof(crc), sizeof(crc));
+    return hdr->magic == log->magic && crc == record_log_crc(log, record);
+}
+
+/* Storage partition of the log, NULL if missing or too small */
+static const partition_entry_t *record_log_area(const record_log_t *log)
+{
+    const partition_entry_t *area = partition_get(kPartitionType_Storage, log->storage, 0);
+
+    if (area == NULL || area->size < RECORD_LOG_PAGES * MFLASH_PAGE_SIZE)
+        return NULL;
+
+    return area;
+}
+
+/** Read the latest record
+ *
+ * @retval kStatus_Success: record holds the latest record
+ *         kStatus_NoData: no record, or no area in the partition table; record is left untouched
+ *         otherwise flash read failed
+ */
+status_t record_log_load(record_log_t *log, void *record)
+{
+    const partition_entry_t *area = record_log_area(log);
+    uint32_t page[MFLASH_PAGE_SIZE / sizeof(uint32_t)];
+    bool found = false;
+    uint32_t i;
+
+    log->page = RECORD_LOG_PAGES - 1;
+
+    if (area == NULL)
+        return kStatus_NoData;
+
+    for (i = 0; i < RECORD_LOG_PAGES; i++)
+    {
+        if (bl_flash_read(area->offset + i * MFLASH_PAGE_SIZE, page, log->size) != 0)
+            return kStatus_Fail;
+
+        if (!record_log_valid(log, page) ||
+            (found && ((record_log_hdr_t *)page)->seq <= ((record_log_hdr_t *)record)->seq))
+            continue;
+
+        memcpy(record, page, log->size);
+        log->page = i;
+        found     = true;
+    }
+
+    return found ? kStatus_Success : kStatus_NoData;
+}
+
+/** Write the record in the next page, with the next seq. The magic, seq and
+ *  CRC32 of record are only updated once it is written.
+ *
+ * @retval kStatus_Success: all OK
+ *         kStatus_NoData: no area in the partition table
+ *         otherwise writing failed
+ */
+status_t record_log_append(record_log_t *log, void *record)
+{
+    const partition_entry_t *area = record_log_area(log);
+    uint32_t page[MFLASH_PAGE_SIZE / sizeof(uint32_t)];
+    record_log_hdr_t *hdr = (record_log_hdr_t *)page;
+    uint32_t next;
+    uint32_t offset;
+    uint32_t crc;
+    status_t status;
+
+    if (area == NULL)
+        return kStatus_NoData;
+
+    next   = (log->page + 1) % RECORD_LOG_PAGES;
+    offset = area->offset + next * MFLASH_PAGE_SIZE;
+
+    if (next % SECTOR_PAGES == 0)
+    {
+        status = flexspi_nor_flash_erase_sector(UPDATE_EXAMPLE_FLEXSPI, offset);
+        sfw_flash_written(offset, MFLASH_SECTOR_SIZE);
+        if (status != kStatus_Success)
+        {
+            LogError(("%s: failed to erase sector at 0x%X", __func__, offset));
+            return status;
+        }
+    }
+
+    memset(page, 0xff, sizeof(page));
+    memcpy(page, record, log->size);
+    hdr->magic = log->magic;
+    hdr->seq   = ((const record_log_hdr_t *)record)->seq + 1;
+    crc        = record_log_crc(log, page);
+    memcpy((uint8_t *)page + log->size - sizeof(crc), &crc, sizeof(crc));
+
+    status = flexspi_nor_flash_program(UPDATE_EXAMPLE_FLEXSPI, offset, page, MFLASH_PAGE_SIZE);
+    sfw_flash_written(offset, MFLASH_PAGE_SIZE);
+    if (status != kStatus_Success)
+    {
+        LogError(("%s: failed to program record at 0x%X", __func__, offset));
+        return status;
+    }
+
+    memcpy(record, page, log->size);
+    log->page = next;
+    return kStatus_Success;
+}
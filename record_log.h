@@ -0,0 +1,47 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef __RECORD_LOG_H__
+#define __RECORD_LOG_H__
+
+#include "fsl_common.h"
+#include "mflash_drv.h"
+#include "partition_table.h"
+
+/*
+ * Log of a fixed size record in a storage partition, such as the update
+ * transaction record (update_txn.c) and the flash wear counters
+ * (flash_wear.c). Each write takes a page, pages being used in turn over
+ * RECORD_LOG_PAGES, and the record with the highest seq wins. The sector about
+ * to be used is erased first, so the previous record survives a power loss.
+ *
+ * Records start with a record_log_hdr_t and end with a CRC32 of the words
+ * before it, all filled in by record_log_append().
+ */
+#define RECORD_LOG_PAGES (2 * MFLASH_SECTOR_SIZE / MFLASH_PAGE_SIZE)
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t seq; /* number of records written */
+} record_log_hdr_t;
+
+typedef struct
+{
+    uint32_t storage; /* kPartitionStorage_[...] */
+    uint32_t magic;
+    uint32_t size;    /* of the record, at most MFLASH_PAGE_SIZE */
+    uint32_t page;    /* of the latest record */
+} record_log_t;
+
+/* Initializer of a record_log_t, before record_log_load() */
+#define RECORD_LOG_INIT(storage, magic, type) {(storage), (magic), sizeof(type), RECORD_LOG_PAGES - 1}
+
+status_t record_log_load(record_log_t *log, void *record);
+status_t record_log_append(record_log_t *log, void *record);
+
+#endif
@@ -0,0 +1,367 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "logging_levels.h"
+#define LIBRARY_LOG_NAME "slot_writer"
+#define LIBRARY_LOG_LEVEL LOG_INFO
+#include "logging_stack.h"
+
+#include <string.h>
+
+#include "slot_writer.h"
+#include "erase_ahead.h"
+#include "flash_wear.h"
+#include "flexspi_flash_config.h"
+
+#define SECTOR_PAGES (MFLASH_SECTOR_SIZE / MFLASH_PAGE_SIZE)
+#define PAGE_WORDS   (MFLASH_PAGE_SIZE / sizeof(uint32_t))
+
+static bool page_is_blank(const uint32_t *page)
+{
+    uint32_t i;
+
+    for (i = 0; i < PAGE_WORDS; i++)
+    {
+        if (page[i] != 0xffffffff)
+            return false;
+    }
+    return true;
+}
+
+#ifdef AKNANO_SLOT_WRITER_SKIP_UNCHANGED
+/* Slots often hold an image close to the incoming one (A/B/A releases), so
+ * comparing each sector with the slot content saves most of the erases */
+
+/** Compare the pending sector with the flash content
+ *
+ * @param changed set to the mask of the pages that differ
+ * @param need_erase set when some bit has to go from 0 to 1
+ *
+ * @retval kStatus_Success: all OK
+ *         otherwise flash read failed
+ */
+static status_t slot_writer_compare_sector(slot_writer_t *writer, uint32_t sector_off, uint32_t *changed,
+                                           bool *need_erase)
+{
+    const uint32_t *page;
+    uint32_t p;
+    uint32_t i;
+
+    *changed    = 0;
+    *need_erase = false;
+
+    for (p = 0; p < SECTOR_PAGES; p++)
+    {
+        if (bl_flash_read(writer->ptn.start + sector_off + p * MFLASH_PAGE_SIZE, writer->page_buf, MFLASH_PAGE_SIZE) !=
+            0)
+        {
+            LogError(("%s: flash read failed at 0x%X", __func__, writer->ptn.start + sector_off + p * MFLASH_PAGE_SIZE));
+            return kStatus_Fail;
+        }
+
+        page = &writer->sector_buf[p * PAGE_WORDS];
+        for (i = 0; i < PAGE_WORDS; i++)
+        {
+            if (page[i] != writer->page_buf[i])
+            {
+                *changed |= 1U << p;
+                if ((page[i] & writer->page_buf[i]) != page[i])
+                {
+                    *need_erase = true;
+                    return kStatus_Success;
+                }
+            }
+        }
+    }
+
+    return kStatus_Success;
+}
+#endif
+
+/** Write the pending sector, padding it with the erased value if incomplete
+ *
+ * @retval kStatus_Success: all OK
+ *         otherwise something failed
+ */
+static status_t slot_writer_flush_sector(slot_writer_t *writer)
+{
+    uint32_t sector_off = writer->written - writer->sector_fill;
+    uint32_t page_off;
+    uint32_t changed = (1U << SECTOR_PAGES) - 1;
+    bool need_erase  = true;
+    bool known_dirty = false;
+    const uint32_t *page;
+    uint32_t p;
+    uint32_t last;
+    status_t status;
+
+    if (writer->sector_fill == 0)
+        return kStatus_Success;
+
+    memset((uint8_t *)writer->sector_buf + writer->sector_fill, 0xff, MFLASH_SECTOR_SIZE - writer->sector_fill);
+
+#ifdef AKNANO_SLOT_WRITER_SKIP_UNCHANGED
+    status = slot_writer_compare_sector(writer, sector_off, &changed, &need_erase);
+    if (status != kStatus_Success)
+        return status;
+
+    if (changed == 0)
+    {
+        writer->stats.sectors_unchanged++;
+        writer->sector_fill = 0;
+        return kStatus_Success;
+    }
+
+    /* the comparison found bits to set, no need to read the sector again */
+    known_dirty = need_erase;
+#endif
+
+    if (need_erase)
+    {
+        /* unless the erase task already did it */
+        status = erase_ahead_erase_sector(writer->ptn.start + sector_off, known_dirty);
+        if (status != kStatus_Success)
+            return status;
+        writer->stats.sectors_erased++;
+    }
+    else
+        writer->stats.sectors_programmed++;
+
+    for (p = 0; p < SECTOR_PAGES; p = last)
+    {
+        /* erased pages need nothing, and changed ones only clear bits; the
+         * others are programmed in runs of consecutive pages */
+        for (last = p; last < SECTOR_PAGES; last++)
+        {
+            page = &writer->sector_buf[last * PAGE_WORDS];
+            if ((need_erase && page_is_blank(page)) || (!need_erase && (changed & (1U << last)) == 0))
+                break;
+        }
+
+        if (last == p)
+        {
+            last++;
+            continue;
+        }
+
+        page_off = sector_off + p * MFLASH_PAGE_SIZE;
+        erase_ahead_mark_written(writer->ptn.start + page_off, (last - p) * MFLASH_PAGE_SIZE);
+        status = flexspi_nor_flash_program(UPDATE_EXAMPLE_FLEXSPI, writer->ptn.start + page_off,
+                                           &writer->sector_buf[p * PAGE_WORDS], (last - p) * MFLASH_PAGE_SIZE);
+        sfw_flash_written(writer->ptn.start + page_off, (last - p) * MFLASH_PAGE_SIZE);
+        if (status != kStatus_Success)
+        {
+            LogError(("%s: failed to program pages at 0x%X", __func__, writer->ptn.start + page_off));
+            return status;
+        }
+        writer->stats.pages_programmed += last - p;
+    }
+#ifndef AKNANO_SLOT_WRITER_SKIP_UNCHANGED
+    erase_ahead_writer_progress(writer->ptn.start + sector_off + MFLASH_SECTOR_SIZE);
+#endif
+
+    writer->sector_fill = 0;
+    return kStatus_Success;
+}
+
+/** Prepare writing a new image into the slot returned by bl_get_update_partition_info()
+ *
+ * @retval kStatus_Success: all OK
+ *         otherwise the update slot is not available
+ */
+status_t slot_writer_init(slot_writer_t *writer)
+{
+    partition_t ptn;
+    status_t status;
+
+    status = bl_get_update_partition_info(&ptn);
+    if (status != kStatus_Success)
+        return status;
+
+    return slot_writer_init_partition(writer, &ptn);
+}
+
+/** Prepare writing a new image into the given slot, such as a slot of a data
+ *  image (see update_txn.c)
+ *
+ * @retval kStatus_Success: all OK
+ *         otherwise something failed
+ */
+status_t slot_writer_init_partition(slot_writer_t *writer, const partition_t *ptn)
+{
+    memset(writer, 0, sizeof(*writer));
+    writer->ptn = *ptn;
+
+    /* whatever was verified or cached about this slot is about to be overwritten */
+    bl_verify_mark_verified(0, 0);
+    bl_invalidate_image_state();
+    erase_ahead_writer_start(writer->ptn.start, writer->ptn.size);
+#ifdef AKNANO_IMAGE_ENCRYPTION
+    image_decrypt_init(&writer->decrypt);
+#endif
+
+    return bl_verify_init(&writer->verify);
+}
+
+/** Continue writing an image of which the first offset bytes are already in the slot,
+ *  as left by an interrupted download. These bytes are read back to bring the
+ *  image verification up to date. Must follow slot_writer_init().
+ *
+ * @param offset number of bytes already written, multiple of MFLASH_SECTOR_SIZE
+ *
+ * @retval kStatus_Success: writing can go on from offset
+ *         otherwise something failed
+ */
+status_t slot_writer_resume(slot_writer_t *writer, uint32_t offset)
+{
+    uint32_t pos;
+    status_t status;
+
+    if (offset % MFLASH_SECTOR_SIZE != 0 || offset > writer->ptn.size || writer->written != 0)
+        return kStatus_InvalidArgument;
+
+    for (pos = 0; pos < offset; pos += MFLASH_SECTOR_SIZE)
+    {
+        if (bl_flash_read(writer->ptn.start + pos, writer->sector_buf, MFLASH_SECTOR_SIZE) != 0)
+        {
+            LogError(("%s: flash read failed at 0x%X", __func__, writer->ptn.start + pos));
+            return kStatus_Fail;
+        }
+
+#ifdef AKNANO_IMAGE_ENCRYPTION
+        /* the slot holds the decrypted image, only the rest of the payload needs decrypting */
+        if (pos == 0)
+        {
+            status = image_decrypt_set_header(&writer->decrypt, (const struct image_header *)writer->sector_buf);
+            if (status != kStatus_Success)
+                return status;
+        }
+#endif
+
+        status = bl_verify_update(&writer->verify, (const uint8_t *)writer->sector_buf, MFLASH_SECTOR_SIZE);
+        if (status != kStatus_Success)
+            return status;
+    }
+
+    writer->written = offset;
+    erase_ahead_writer_start(writer->ptn.start + offset, writer->ptn.size - offset);
+
+    LogInfo(("Resuming image write at offset %lu", offset));
+    return kStatus_Success;
+}
+
+/** Append the next chunk of the image to the slot.
+ *  Data is written sector by sector and hashed as it goes, so that no read back
+ *  pass is needed once the last byte is written.
+ *
+ * @retval kStatus_Success: all OK
+ *         otherwise writing failed or the image is invalid
+ */
+status_t slot_writer_write(slot_writer_t *writer, const uint8_t *data, uint32_t len)
+{
+    status_t status;
+
+    if (writer->written + len > writer->ptn.size)
+    {
+        LogError(("%s: image does not fit in slot (%lu > %lu)", __func__, writer->written + len, writer->ptn.size));
+        return kStatus_OutOfRange;
+    }
+
+    while (len > 0)
+    {
+        uint32_t n    = MFLASH_SECTOR_SIZE - writer->sector_fill;
+        uint8_t *dest = (uint8_t *)writer->sector_buf + writer->sector_fill;
+
+        if (n > len)
+            n = len;
+
+        memcpy(dest, data, n);
+
+#ifdef AKNANO_IMAGE_ENCRYPTION
+        /* the header is complete, and still in the first sector */
+        if (writer->written < IMAGE_HEADER_SIZE && writer->written + n >= IMAGE_HEADER_SIZE)
+        {
+            status = image_decrypt_set_header(&writer->decrypt, (const struct image_header *)writer->sector_buf);
+            if (status != kStatus_Success)
+                return status;
+        }
+
+        status = image_decrypt_update(&writer->decrypt, writer->written, dest, n);
+        if (status != kStatus_Success)
+            return status;
+#endif
+
+        status = bl_verify_update(&writer->verify, dest, n);
+        if (status != kStatus_Success)
+            return status;
+
+        writer->sector_fill += n;
+        writer->written += n;
+        data += n;
+        len -= n;
+
+        if (writer->sector_fill == MFLASH_SECTOR_SIZE)
+        {
+            status = slot_writer_flush_sector(writer);
+            if (status != kStatus_Success)
+                return status;
+        }
+    }
+
+    return kStatus_Success;
+}
+
+/** Flush the last sector and complete the image verification.
+ *  On success, bl_verify_image() on the same slot and size returns immediately.
+ *
+ * @retval kStatus_Success: image is written and valid
+ *         otherwise something failed
+ */
+status_t slot_writer_finish(slot_writer_t *writer)
+{
+    status_t status;
+
+    status = slot_writer_flush_sector(writer);
+    bl_invalidate_image_state();
+    erase_ahead_writer_stop();
+#ifdef AKNANO_IMAGE_ENCRYPTION
+    image_decrypt_free(&writer->decrypt);
+#endif
+    if (status != kStatus_Success)
+        return status;
+
+    status = bl_verify_finish(&writer->verify);
+    if (status != kStatus_Success)
+        return status;
+
+    bl_verify_mark_verified(writer->ptn.start, writer->written);
+    LogInfo(("Image of %lu bytes written and verified at 0x%X", writer->written, writer->ptn.start));
+    LogInfo(("Sectors: %lu unchanged, %lu programmed, %lu erased; %lu pages programmed",
+             writer->stats.sectors_unchanged, writer->stats.sectors_programmed, writer->stats.sectors_erased,
+             writer->stats.pages_programmed));
+
+    /* most of the flash wear comes with images, keep the counters */
+    status = flash_wear_flush();
+    if (status != kStatus_Success && status != kStatus_NoData)
+        LogWarn(("Flash wear log not updated: %d", status));
+
+    return kStatus_Success;
+}
+
+#ifdef AKNANO_IMAGE_ENCRYPTION
+/** Provide the end of the image, holding the key of an encrypted image, see
+ *  image_decrypt_set_tail(). Must be called before the payload is written.
+ *
+ * @retval kStatus_Success: the key is known
+ *         kStatus_NoData: the image is not encrypted with AES-KW-128
+ *         otherwise something failed
+ */
+status_t slot_writer_set_image_tail(slot_writer_t *writer, const uint8_t *tail, uint32_t len)
+{
+    return image_decrypt_set_tail(&writer->decrypt, tail, len);
+}
+#endif
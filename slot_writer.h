@@ -0,0 +1,51 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef __SLOT_WRITER_H__
+#define __SLOT_WRITER_H__
+
+#include "fsl_common.h"
+#include "mflash_drv.h"
+#include "mcuboot_app_support.h"
+#ifdef AKNANO_IMAGE_ENCRYPTION
+#include "image_decrypt.h"
+#endif
+
+/* Counters of the flash operations done for an image */
+typedef struct
+{
+    uint32_t sectors_unchanged;  /* sectors that already held the data */
+    uint32_t sectors_programmed; /* sectors programmed without an erase */
+    uint32_t sectors_erased;     /* sectors erased and programmed */
+    uint32_t pages_programmed;
+} slot_writer_stats_t;
+
+/* Streams an OTA image into the candidate slot, verifying it on the fly */
+typedef struct
+{
+    partition_t ptn;
+    uint32_t written;     /* image bytes received so far */
+    uint32_t sector_fill; /* bytes pending in sector_buf */
+    uint32_t sector_buf[MFLASH_SECTOR_SIZE / sizeof(uint32_t)];
+    uint32_t page_buf[MFLASH_PAGE_SIZE / sizeof(uint32_t)];
+    slot_writer_stats_t stats;
+    bl_verify_ctx_t verify;
+#ifdef AKNANO_IMAGE_ENCRYPTION
+    image_decrypt_t decrypt;
+#endif
+} slot_writer_t;
+
+status_t slot_writer_init(slot_writer_t *writer);
+status_t slot_writer_init_partition(slot_writer_t *writer, const partition_t *ptn);
+status_t slot_writer_resume(slot_writer_t *writer, uint32_t offset);
+status_t slot_writer_write(slot_writer_t *writer, const uint8_t *data, uint32_t len);
+status_t slot_writer_finish(slot_writer_t *writer);
+#ifdef AKNANO_IMAGE_ENCRYPTION
+status_t slot_writer_set_image_tail(slot_writer_t *writer, const uint8_t *tail, uint32_t len);
+#endif
+
+#endif
@@ -0,0 +1,406 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "logging_levels.h"
+#define LIBRARY_LOG_NAME "update_txn"
+#define LIBRARY_LOG_LEVEL LOG_INFO
+#include "logging_stack.h"
+
+#include <string.h>
+
+#include "update_txn.h"
+#include "erase_ahead.h"
+#include "flexspi_flash_config.h"
+#include "record_log.h"
+
+#define UPDATE_TXN_NO_IMAGE PARTITION_MAX_IDS
+
+static update_txn_record_t record;
+static record_log_t record_log = RECORD_LOG_INIT(kPartitionStorage_UpdateTxn, UPDATE_TXN_MAGIC, update_txn_record_t);
+static bool record_loaded;
+
+/* The running application is the one the pending slots were staged with */
+static bool pending_in_use;
+
+static bool update_txn_has_pending(void)
+{
+    uint32_t i;
+
+    for (i = 1; i < PARTITION_MAX_IDS; i++)
+    {
+        if (record.pending[i] != UPDATE_TXN_NO_SLOT)
+            return true;
+    }
+    return false;
+}
+
+/* Append the record to the update transaction log */
+static status_t update_txn_write_record(void)
+{
+    status_t status = record_log_append(&record_log, &record);
+
+    if (status == kStatus_NoData)
+        LogError(("%s: no update transaction area in the partition table", __func__));
+
+    return status;
+}
+
+/* Make the pending slots the ones in use */
+static status_t update_txn_apply_pending(void)
+{
+    uint32_t i;
+
+    for (i = 1; i < PARTITION_MAX_IDS; i++)
+    {
+        if (record.pending[i] != UPDATE_TXN_NO_SLOT)
+            record.active[i] = record.pending[i];
+        record.pending[i] = UPDATE_TXN_NO_SLOT;
+    }
+    pending_in_use = false;
+
+    return update_txn_write_record();
+}
+
+/* Settle the pending slots of a previous boot with the outcome of the
+ * application update they go with */
+static status_t update_txn_resolve(void)
+{
+    uint8_t digest[BL_SHA256_DIGEST_SIZE];
+    uint32_t state;
+    status_t status;
+    uint32_t i;
+
+    status = bl_get_image_state(&state);
+    if (status == kStatus_Success)
+        status = bl_get_image_digest(partition_slot(0, get_active_image())->offset, digest);
+    if (status != kStatus_Success)
+    {
+        LogError(("%s: failed to get the running image", __func__));
+        return status;
+    }
+
+    if (memcmp(digest, record.app_digest, BL_SHA256_DIGEST_SIZE) != 0)
+    {
+        /* the swap has not happened yet */
+        if (state == kSwapType_ReadyForTest)
+            return kStatus_Success;
+
+        LogInfo(("Application update was reverted, dropping the data images staged with it"));
+        for (i = 1; i < PARTITION_MAX_IDS; i++)
+            record.pending[i] = UPDATE_TXN_NO_SLOT;
+        return update_txn_write_record();
+    }
+
+    if (state == kSwapType_Testing)
+    {
+        LogInfo(("Application under test, using the data images staged with it"));
+        pending_in_use = true;
+        return kStatus_Success;
+    }
+
+    LogInfo(("Application update confirmed, keeping the data images staged with it"));
+    return update_txn_apply_pending();
+}
+
+/* Read the latest record, done once on first use */
+static status_t update_txn_load(void)
+{
+    status_t status;
+    uint32_t i;
+
+    if (record_loaded)
+        return kStatus_Success;
+    record_loaded = true;
+
+    memset(&record, 0, sizeof(record));
+    memset(record.pending, UPDATE_TXN_NO_SLOT, sizeof(record.pending));
+
+    status = record_log_load(&record_log, &record);
+    if (status == kStatus_NoData)
+        return kStatus_Success;
+    if (status != kStatus_Success)
+        return status;
+
+    for (i = 0; i < PARTITION_MAX_IDS; i++)
+    {
+        if (record.active[i] > PARTITION_SLOT_SECONDARY)
+            record.active[i] = PARTITION_SLOT_PRIMARY;
+    }
+
+    return update_txn_has_pending() ? update_txn_resolve() : kStatus_Success;
+}
+
+/** Start a new update transaction
+ *
+ * @retval kStatus_Success: all OK
+ *         kStatus_Busy: a previous update waits for the application to be confirmed
+ *         otherwise something failed
+ */
+status_t update_txn_begin(update_txn_t *txn)
+{
+    status_t status;
+
+    memset(txn, 0, sizeof(*txn));
+    txn->current = UPDATE_TXN_NO_IMAGE;
+
+    status = update_txn_load();
+    if (status != kStatus_Success)
+        return status;
+
+    if (update_txn_has_pending())
+    {
+        LogError(("Previous update is not confirmed yet, update is forbidden"));
+        return kStatus_Busy;
+    }
+
+    return kStatus_Success;
+}
+
+/** Prepare writing an image into its inactive slot. Images are staged one at a
+ *  time, staging an image again replaces it.
+ *
+ * @param image 0 for the application, otherwise a data image number
+ *
+ * @retval kStatus_Success: all OK
+ *         kStatus_NoData: the image has no slots
+ *         otherwise something failed
+ */
+status_t update_txn_stage_begin(update_txn_t *txn, uint32_t image)
+{
+    const partition_entry_t *slot;
+    partition_t ptn;
+    status_t status;
+
+    if (txn->current != UPDATE_TXN_NO_IMAGE || image >= PARTITION_MAX_IDS)
+        return kStatus_InvalidArgument;
+
+    txn->staged &= ~(1U << image);
+
+    if (image == 0)
+    {
+        status = slot_writer_init(&txn->writer);
+        if (status != kStatus_Success)
+            return status;
+
+        slot             = partition_slot(0, PARTITION_SLOT_SECONDARY);
+        txn->slot[image] = txn->writer.ptn.start == slot->offset ? PARTITION_SLOT_SECONDARY : PARTITION_SLOT_PRIMARY;
+    }
+    else
+    {
+        txn->slot[image] = record.active[image] == PARTITION_SLOT_PRIMARY ? PARTITION_SLOT_SECONDARY :
+                                                                            PARTITION_SLOT_PRIMARY;
+
+        slot = partition_slot(image, txn->slot[image]);
+        if (slot == NULL)
+        {
+            LogError(("%s: no slots for image %lu in the partition table", __func__, image));
+            return kStatus_NoData;
+        }
+
+        ptn.start = slot->offset;
+        ptn.size  = slot->size;
+        status    = slot_writer_init_partition(&txn->writer, &ptn);
+        if (status != kStatus_Success)
+            return status;
+    }
+
+    txn->current = image;
+    LogInfo(("Staging image %lu at 0x%X", image, txn->writer.ptn.start));
+    return kStatus_Success;
+}
+
+/** Append the next chunk of the image being staged, see slot_writer_write()
+ *
+ * @retval kStatus_Success: all OK
+ *         otherwise writing failed or the image is invalid
+ */
+status_t update_txn_stage_write(update_txn_t *txn, const uint8_t *data, uint32_t len)
+{
+    if (txn->current == UPDATE_TXN_NO_IMAGE)
+        return kStatus_InvalidArgument;
+
+    return slot_writer_write(&txn->writer, data, len);
+}
+
+/** Complete the image being staged, see slot_writer_finish()
+ *
+ * @retval kStatus_Success: image is written and valid
+ *         otherwise something failed
+ */
+status_t update_txn_stage_finish(update_txn_t *txn)
+{
+    uint32_t image = txn->current;
+    status_t status;
+
+    if (image == UPDATE_TXN_NO_IMAGE)
+        return kStatus_InvalidArgument;
+
+    txn->current = UPDATE_TXN_NO_IMAGE;
+
+    status = slot_writer_finish(&txn->writer);
+    if (status != kStatus_Success)
+        return status;
+
+    txn->size[image] = txn->writer.written;
+    txn->staged |= 1U << image;
+    return kStatus_Success;
+}
+
+/** Verify all the staged images and switch to them at once.
+ *  Data images alone are used right away. With the application, they are used
+ *  by the new application once the bootloader swapped to it, and dropped if it
+ *  reverts.
+ *
+ * @retval kStatus_Success: all OK, reboot to run a new application
+ *         otherwise nothing changed
+ */
+status_t update_txn_commit(update_txn_t *txn)
+{
+    const partition_entry_t *slot;
+    uint8_t digest[BL_SHA256_DIGEST_SIZE];
+    uint8_t running[BL_SHA256_DIGEST_SIZE];
+    uint8_t pending[PARTITION_MAX_IDS];
+    bool with_data = false;
+    status_t status;
+    uint32_t i;
+
+    if (txn->current != UPDATE_TXN_NO_IMAGE || txn->staged == 0)
+        return kStatus_InvalidArgument;
+
+    memset(pending, UPDATE_TXN_NO_SLOT, sizeof(pending));
+
+    for (i = 0; i < PARTITION_MAX_IDS; i++)
+    {
+        if ((txn->staged & (1U << i)) == 0)
+            continue;
+
+        slot = partition_slot(i, txn->slot[i]);
+        if (bl_verify_image((const uint8_t *)slot->offset, txn->size[i]) != 1)
+        {
+            LogError(("Staged image %lu is invalid, update aborted", i));
+            return kStatus_Fail;
+        }
+
+        if (i != 0)
+        {
+            pending[i] = txn->slot[i];
+            with_data  = true;
+        }
+    }
+
+    if ((txn->staged & 1U) != 0)
+    {
+        status = bl_get_image_digest(partition_slot(0, txn->slot[0])->offset, digest);
+        if (status == kStatus_Success)
+            status = bl_get_image_digest(partition_slot(0, get_active_image())->offset, running);
+        if (status != kStatus_Success)
+            return status;
+
+        /* nothing to swap, and the pending slots could not be told from a reverted update */
+        if (memcmp(digest, running, BL_SHA256_DIGEST_SIZE) == 0)
+        {
+            LogInfo(("Staged application is the running one, only updating data images"));
+            txn->staged &= ~1U;
+        }
+    }
+
+    if ((txn->staged & 1U) == 0)
+    {
+        if (!with_data)
+        {
+            LogInfo(("Nothing to update"));
+            return kStatus_Success;
+        }
+
+        for (i = 1; i < PARTITION_MAX_IDS; i++)
+        {
+            if (pending[i] != UPDATE_TXN_NO_SLOT)
+                record.active[i] = pending[i];
+        }
+
+        status = update_txn_write_record();
+        if (status == kStatus_Success)
+            LogInfo(("Data images updated"));
+        return status;
+    }
+
+    if (with_data)
+    {
+        memcpy(record.app_digest, digest, BL_SHA256_DIGEST_SIZE);
+        memcpy(record.pending, pending, sizeof(record.pending));
+        status = update_txn_write_record();
+        if (status != kStatus_Success)
+            return status;
+    }
+
+    /* without a swap request, the pending slots are dropped on next boot */
+    status = bl_update_image_state(kSwapType_ReadyForTest);
+    if (status == kStatus_Success)
+        LogInfo(("Update staged, the new images are used after reboot"));
+    return status;
+}
+
+/** Give up a transaction. Staged slots are left as they are, they are not in use. */
+void update_txn_abort(update_txn_t *txn)
+{
+    if (txn->current != UPDATE_TXN_NO_IMAGE)
+    {
+        erase_ahead_writer_stop();
+        bl_invalidate_image_state();
+    }
+
+    txn->current = UPDATE_TXN_NO_IMAGE;
+    txn->staged  = 0;
+}
+
+/** Find the slot holding the current content of a data image, an image as
+ *  produced by imgtool with its payload after the image header
+ *
+ * @param image data image number, 1 and up
+ *
+ * @retval kStatus_Success: ptn content is valid
+ *         kStatus_NoData: the image has no slots
+ *         otherwise something failed
+ */
+status_t update_txn_data_slot(uint32_t image, partition_t *ptn)
+{
+    const partition_entry_t *slot;
+    status_t status;
+
+    if (image == 0 || image >= PARTITION_MAX_IDS)
+        return kStatus_InvalidArgument;
+
+    status = update_txn_load();
+    if (status != kStatus_Success)
+        return status;
+
+    slot = partition_slot(image, pending_in_use && record.pending[image] != UPDATE_TXN_NO_SLOT ?
+                                     record.pending[image] :
+                                     record.active[image]);
+    if (slot == NULL)
+        return kStatus_NoData;
+
+    ptn->start = slot->offset;
+    ptn->size  = slot->size;
+    return kStatus_Success;
+}
+
+/** Keep the data images staged with the running application, called once it
+ *  is marked as permanent
+ */
+void update_txn_app_confirmed(void)
+{
+    if (!record_loaded)
+    {
+        /* resolved from the updated trailers */
+        update_txn_load();
+        return;
+    }
+
+    if (pending_in_use && update_txn_apply_pending() != kStatus_Success)
+        LogError(("%s: failed to record the data images in use", __func__));
+}
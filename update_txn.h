@@ -0,0 +1,64 @@
+/*
+ * Copyright 2022 Foundries.io
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef __UPDATE_TXN_H__
+#define __UPDATE_TXN_H__
+
+#include "fsl_common.h"
+#include "slot_writer.h"
+#include "partition_table.h"
+
+/*
+ * Update of several images at once: the application (image 0) and data
+ * images (1 and up), such as a model or a calibration table, each with a pair
+ * of slots in the partition table. Data images are signed with imgtool like
+ * the application, so that they are verified the same way.
+ *
+ * Images are staged one after the other into their inactive slot, then
+ * update_txn_commit() verifies all of them and switches to the new set with a
+ * single record write in the kPartitionStorage_UpdateTxn partition.
+ *
+ * When the application is part of the update, the new data slots are only
+ * used by the new application while it is tested, and kept once it is
+ * confirmed (bl_update_image_state(kSwapType_Permanent)). If the bootloader
+ * reverts it, the data slots in use before the update are restored.
+ */
+#define UPDATE_TXN_MAGIC 0x58544b41 /* "AKTX" */
+
+#define UPDATE_TXN_NO_SLOT 0xff
+
+/* As stored in flash, one record per page, the one with the highest seq wins */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t seq;
+    uint8_t active[PARTITION_MAX_IDS];  /* slot in use of each data image, index 0 unused */
+    uint8_t pending[PARTITION_MAX_IDS]; /* slot to use once the application is confirmed, or UPDATE_TXN_NO_SLOT */
+    uint8_t app_digest[BL_SHA256_DIGEST_SIZE]; /* application the pending slots go with */
+    uint32_t crc;                              /* CRC32 of the fields above */
+} update_txn_record_t;
+
+typedef struct
+{
+    slot_writer_t writer;
+    uint32_t current;                 /* image being staged, PARTITION_MAX_IDS when none */
+    uint32_t staged;                  /* mask of the images staged and verified */
+    uint32_t size[PARTITION_MAX_IDS]; /* size of each staged image */
+    uint8_t slot[PARTITION_MAX_IDS];  /* slot each image is staged into */
+} update_txn_t;
+
+status_t update_txn_begin(update_txn_t *txn);
+status_t update_txn_stage_begin(update_txn_t *txn, uint32_t image);
+status_t update_txn_stage_write(update_txn_t *txn, const uint8_t *data, uint32_t len);
+status_t update_txn_stage_finish(update_txn_t *txn);
+status_t update_txn_commit(update_txn_t *txn);
+void update_txn_abort(update_txn_t *txn);
+
+status_t update_txn_data_slot(uint32_t image, partition_t *ptn);
+void update_txn_app_confirmed(void);
+
+#endif